@@ -3,29 +3,100 @@
 // license that can be found in the LICENSE file.
 
 // Framebuffer console driver, using the I_Framebuffer interface
+//
+// FB is the framebuffer type the console calls. By default this is
+// I_Framebuffer<T>, and every call is dispatched virtually, so any driver can
+// be attached at runtime. Naming a concrete driver instead (e.g.
+// FBConsole<uint16_t, ILI9341>) dispatches statically. The driver class should
+// be marked final, so that calls through it are not virtual, and should
+// instantiate its console in its own .cpp (see FBConsole_impl.hpp), so the
+// compiler can inline the driver into the renderer.
+//
+// The console keeps the glyph and colour of every cell, so it can be unbound
+// from its framebuffer and keep accepting output into memory, then repaint
+// the whole screen when bound again. Cells store an index into a small
+// palette of up to 16 colours, so each costs two bytes. When the palette is
+// full, a new colour takes the place of one no cell uses any more; if every
+// entry is in use, set_foreground and set_background refuse the colour.
+//
+// When a character replaces another in the same colours, only the pixels
+// where the two glyphs differ are redrawn, either as one window around them
+// or as a window per differing row, whichever sends fewer bytes.
+//
+// Changes to the cells can also be reported to an FBMirror, which encodes
+// them into a compact stream for showing the screen on a host.
+//
+// The rows with text on, worked out from the cells, can be passed to the
+// framebuffer's set_text_rows hint, for drivers that can stop refreshing
+// blank rows.
 
 #ifndef FBCONSOLE_H
 #define FBCONSOLE_H
 
 #include "I_Framebuffer.hpp"
+#include "fbmirror.hpp"
 
-template <class T>
+template <class T, class FB = I_Framebuffer<T>>
 class FBConsole {
     public:
-        FBConsole(I_Framebuffer<T>* framebuffer, uint8_t* font, uint8_t scale = 1);
+        FBConsole(FB* framebuffer, uint8_t* font, uint8_t scale = 1);
+        ~FBConsole();
+        FBConsole(const FBConsole&) = delete;
+        FBConsole& operator=(const FBConsole&) = delete;
 
         void put_char(char c);
         void put_string(const char* str);
         void clear();
 
         void set_location(uint16_t x, uint16_t y);
-        void set_background(T);
-        void set_foreground(T);
+        // False, leaving the colour unchanged, if the palette has no room for it
+        bool set_background(T);
+        bool set_foreground(T);
 
         void get_dimensions(uint16_t* width, uint16_t* height);
+
+        // Attach to a framebuffer and repaint it from the cell state
+        void bind(FB* framebuffer);
+        // Detach from the framebuffer; output only updates the cell state.
+        // The repaint strip is only held while bound, so unbound consoles
+        // cost just their cells.
+        void unbind();
+        // Redraw every cell, one row strip per plot_block call
+        void repaint();
+
+        // Pixels sent to the framebuffer, and pixels not sent because only the
+        // part of a cell that changed was redrawn
+        void get_stats(uint32_t* sent, uint32_t* saved);
+
+        // Report changes to a mirror (or 0 for none). The whole screen is sent
+        // at the first flush. The mirror stream addresses cells with one byte
+        // each way, so a console over 255 cells wide or high can't be
+        // mirrored; this returns false and leaves mirroring off.
+        bool set_mirror(FBMirror* mirror);
+        // Send the mirror's pending changes, or the whole screen if it needs it
+        void mirror_flush();
+
+        // Pass the framebuffer the rows with text on, if they may have changed
+        // since the last call. Cells count as text unless their glyph is blank
+        // (or drawn in its background colour) on black. Cells not yet drawn
+        // count as blank. Call it from housekeeping, not after every character.
+        void report_text_rows();
         
     private:
-        I_Framebuffer<T>* _FRAMEBUFFER;
+        uint8_t palette_index(T color);
+        void render_glyph(uint8_t charindex, uint8_t attr, T* buffer, uint32_t stride);
+        uint16_t* cell(uint16_t x, uint16_t y);
+        uint32_t row_pixels();
+        void draw_cell(uint16_t x, uint16_t y, uint16_t previous, uint16_t current);
+        void plot_region(uint16_t dx, uint16_t dy, uint8_t c0, uint8_t c1, uint8_t r0, uint8_t r1);
+        void mirror_sync();
+        bool cell_blank(uint16_t c, T black);
+
+        // Leftmost and rightmost set pixel of a non-zero font row
+        static uint8_t glyph_left(uint8_t row) { return __builtin_clz(row) - 24; }
+        static uint8_t glyph_right(uint8_t row) { return 7 - __builtin_ctz(row); }
+
+        FB* _FRAMEBUFFER;
         uint8_t* _FONT;
         uint16_t _WIDTH;
         uint16_t _HEIGHT;
@@ -36,8 +107,34 @@ class FBConsole {
         uint16_t console_y;
 
         T* _CHARBUF;
+        T* _ROWBUF;     // One row of cells, for repaint; 0 while unbound
+
+        // Cell state: glyph index in the low byte, foreground and background
+        // palette indices in the high byte. Rows are a ring starting at _TOP_ROW.
+        uint16_t* _CELLS;
+        uint16_t _TOP_ROW;
+        T _PALETTE[16];
+        uint8_t _PALETTE_SIZE;
+        uint8_t console_attr;
+        bool _BOUND;
+        bool _TEXT_ROWS_STALE;  // Cells have changed since report_text_rows
+        FBMirror* _MIRROR;
+
+        uint32_t _PIXELS_SENT;
+        uint32_t _PIXELS_SAVED;
 
         const uint16_t _TABSTOP = 8;
+
+        // Glyph index for a cell whose contents on the display are unknown
+        const uint8_t UNKNOWN_GLYPH = 0xFF;
+
+        // Returned by palette_index when every entry is in use
+        const uint8_t PALETTE_FULL = 0xFF;
+
+        // Bytes of overhead to open a window, e.g. SET_COLUMN, SET_PAGE and
+        // WRITE_RAM with their parameters on an ILI9341, used to decide
+        // between redrawing part of a cell as one window or several
+        const uint32_t _WINDOW_COST = 11;
 };
 
 #endif
\ No newline at end of file
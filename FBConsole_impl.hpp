@@ -0,0 +1,596 @@
+// Copyright 2021 Dominic Houghton. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+/* Framebuffer console driver, using the I_Framebuffer interface: template definitions
+
+ * Only include this where an FBConsole is explicitly instantiated. FBConsole.cpp
+ * instantiates the virtually dispatched variants; each driver instantiates
+ * its statically dispatched variant in its own .cpp, where the compiler can
+ * see the driver's definitions and inline them.
+ */
+
+#ifndef FBCONSOLE_IMPL_H
+#define FBCONSOLE_IMPL_H
+
+#include "FBConsole.hpp"
+#include "fbtrace.hpp"
+
+template <class T, class FB>
+FBConsole<T, FB>::FBConsole(FB* framebuffer, uint8_t* font, uint8_t scale)
+{
+    // These will hold the display's actual dimensions while initialising
+    uint16_t display_width, display_height;
+
+    // Set the constants within the class
+    _FRAMEBUFFER = framebuffer;
+    _FONT = font;
+    _SCALE = scale;
+    _BOUND = true;
+    _TEXT_ROWS_STALE = true;
+    _MIRROR = 0;
+
+    // Calculate the console width and height, store them within the class
+    _FRAMEBUFFER->get_dimensions(&display_width, &display_height);
+    _WIDTH = display_width / (8 * _SCALE);
+    _HEIGHT = display_height / (8 * _SCALE);
+
+    /* Create a buffer of pixels, large enough to hold a single character.
+    * The put_char function will use this array, so as to maintain a consistent
+    * memory footprint.
+    * 
+    * Scaling the font to be larger will increase the memory footprint
+    * exponentially.
+    */
+    _CHARBUF = new T[(8 * _SCALE) * (8 * _SCALE)];
+
+    // repaint renders a full row of characters at a time, so each row is one block
+    _ROWBUF = new T[row_pixels()];
+
+    // Set sane defaults for the runtime variables
+    _PALETTE_SIZE = 0;
+    console_background = _FRAMEBUFFER->get_color(0x00,0x00,0x00);   // Black
+    console_foreground = _FRAMEBUFFER->get_color(0xFF,0xFF,0xFF);   // White
+    console_attr = (palette_index(console_foreground) << 4) | palette_index(console_background);
+    console_x = 0;
+    console_y = 0;
+
+    // Nothing is known about what the display shows yet, so the first write
+    // to each cell draws all of it
+    _CELLS = new uint16_t[_WIDTH * _HEIGHT];
+    _TOP_ROW = 0;
+    for (int i = 0; i < (_WIDTH * _HEIGHT); i++)
+        _CELLS[i] = (console_attr << 8) | UNKNOWN_GLYPH;
+    _PIXELS_SENT = 0;
+    _PIXELS_SAVED = 0;
+}
+
+template <class T, class FB>
+FBConsole<T, FB>::~FBConsole()
+{
+    delete[] _CHARBUF;
+    delete[] _ROWBUF;
+    delete[] _CELLS;
+}
+
+template <class T, class FB>
+uint8_t FBConsole<T, FB>::palette_index(T color)
+{
+    for (int i = 0; i < _PALETTE_SIZE; i++)
+    {
+        if (_PALETTE[i] == color)
+            return i;
+    }
+
+    uint8_t index;
+    if (_PALETTE_SIZE < 16)
+    {
+        index = _PALETTE_SIZE++;
+    }
+    else
+    {
+        // Find an entry no cell or current colour uses. Changing one that is
+        // in use would recolour those cells on the next repaint.
+        uint16_t used = (1 << (console_attr >> 4)) | (1 << (console_attr & 0x0F));
+        for (int i = 0; i < (_WIDTH * _HEIGHT); i++)
+            used |= (1 << (_CELLS[i] >> 12)) | (1 << ((_CELLS[i] >> 8) & 0x0F));
+        if (used == 0xFFFF)
+            return PALETTE_FULL;
+
+        index = __builtin_ctz(~used);
+    }
+
+    _PALETTE[index] = color;
+    if (_MIRROR)
+        _MIRROR->palette(index, color);
+    return index;
+}
+
+template <class T, class FB>
+uint16_t* FBConsole<T, FB>::cell(uint16_t x, uint16_t y)
+{
+    return &_CELLS[(((y + _TOP_ROW) % _HEIGHT) * _WIDTH) + x];
+}
+
+template <class T, class FB>
+void FBConsole<T, FB>::render_glyph(uint8_t charindex, uint8_t attr, T* buffer, uint32_t stride)
+{
+    T* color;
+    T* foreground = &_PALETTE[attr >> 4];
+    T* background = &_PALETTE[attr & 0x0F];
+
+    // Iterate through the character data
+    for (int cy = 0; cy < 8; cy++)
+    {
+        for (int cx = 0; cx < 8; cx++)
+        {
+            // Test the bit
+            if ( ((_FONT[(charindex * 8) + cy] << cx) & 0x80) == 0x80 )
+                color = foreground;
+            else 
+                color = background;
+
+            // Plot the color in the buffer
+            for (int by = 0; by < _SCALE; by++)
+            {
+                for (int bx = 0; bx < _SCALE; bx++)
+                {
+                    buffer[ (((cy * _SCALE) + by) * stride) + (cx * _SCALE) + bx] = *color;
+                }
+            }
+        }
+    }
+}
+
+template <class T, class FB>
+void FBConsole<T, FB>::put_char(char c)
+{
+    // Determine the character to draw
+    uint16_t charindex = 0;
+    bool drawchar = true;
+    int count;
+
+    // Handle special-case characters, or calculate the font index
+    switch (c)
+    {
+        case '\n':      // Line feed, handled unix-style
+            drawchar = false;
+            console_x = 0;
+            console_y++;
+            break;
+
+        case '\r':      // Carriage return
+            drawchar = false;
+            console_x = 0;
+            break;
+
+        case '\t':      // Tab
+            count = _TABSTOP - ((console_x) % _TABSTOP);
+        
+            for (int i = 0; i < count; i++)
+                put_char(' ');
+            drawchar = false;
+            break;
+
+        case '\b':      // Backspace
+            if (console_x > 0)
+                console_x--;
+            drawchar = false;
+            break;
+
+        // If character is none of the special cases above
+        default:
+            // Test if the character is mapped in the font
+            if (((uint8_t)c >= 0x20) && ((uint8_t)c <= 0x7E))
+                charindex = (c - 0x20);
+            else
+                charindex = 95;     // font[95] contains the "invalid" glyph
+
+            break;
+    }
+    
+    if (drawchar) {
+        // Record the character in the cell state, and draw whatever changed
+        uint16_t* target = cell(console_x, console_y);
+        uint16_t previous = *target;
+        *target = (console_attr << 8) | charindex;
+        _TEXT_ROWS_STALE = true;
+        if (_MIRROR)
+            _MIRROR->cell(console_x, console_y, charindex, console_attr);
+
+        FBTRACE(FBTRACE_GLYPH_BEGIN, 0, (uint8_t)c, console_x, console_y, _BOUND);
+        if (_BOUND)
+            draw_cell(console_x, console_y, previous, *target);
+        FBTRACE(FBTRACE_GLYPH_END, 0, (uint8_t)c, console_x, console_y, _BOUND);
+
+        // Increase console_x
+        console_x++;
+    }
+
+    // Test console_x, increment console_y if necessary
+    if (console_x >= _WIDTH)
+    {
+        console_x = 0;
+        console_y++;
+    }
+
+    // Test console_y, call scroll_vertical if necessary
+    if (console_y >= _HEIGHT)
+    {
+        // If scrolling, decrement console_y and clear the row
+        console_y--;
+
+        // Rotate the cell rows, and blank the new bottom row
+        _TOP_ROW = (_TOP_ROW + 1) % _HEIGHT;
+        for (int x = 0; x < _WIDTH; x++)
+            *cell(x, console_y) = (console_attr << 8);
+        _TEXT_ROWS_STALE = true;
+        if (_MIRROR)
+            _MIRROR->scroll(console_attr);
+
+        if (_BOUND)
+        {
+            _FRAMEBUFFER->scroll_vertical(8 * _SCALE);
+
+            // Set character with only background
+            for (int i = 0; i < (8 * _SCALE) * (8 * _SCALE); i++)
+                _CHARBUF[i] = console_background;
+
+            // Clear the row with the background color
+            int dy = (console_y * 8 * _SCALE);
+            int dx;
+            for (int x = 0; x < _WIDTH; x++)
+            {
+                dx = (x * 8 * _SCALE);
+            
+                _FRAMEBUFFER->plot_block(dx, dy,
+                            dx + (8 * _SCALE) - 1, dy + (8 * _SCALE) - 1,
+                            _CHARBUF, (8 * _SCALE) * (8 * _SCALE));
+            }
+            _PIXELS_SENT += _WIDTH * (8 * _SCALE) * (8 * _SCALE);
+        }
+    }
+
+    
+}
+
+template <class T, class FB>
+void FBConsole<T, FB>::draw_cell(uint16_t x, uint16_t y, uint16_t previous, uint16_t current)
+{
+    uint8_t charindex = current & 0xFF;
+    uint8_t attr = current >> 8;
+    uint32_t cellpixels = (8 * _SCALE) * (8 * _SCALE);
+
+    uint16_t dx, dy;
+    dx = (x * 8 * _SCALE);
+    dy = (y * 8 * _SCALE);
+
+    // Nothing to do if the cell already shows this
+    if (previous == current)
+    {
+        _PIXELS_SAVED += cellpixels;
+        return;
+    }
+
+    // Let the framebuffer draw the glyph directly if it can. It draws the
+    // whole cell, so all of its pixels count as sent.
+    if (_FRAMEBUFFER->plot_glyph(dx, dy, &_FONT[charindex * 8], _SCALE,
+                                 _PALETTE[attr >> 4], _PALETTE[attr & 0x0F]))
+    {
+        _PIXELS_SENT += cellpixels;
+        return;
+    }
+
+    render_glyph(charindex, attr, _CHARBUF, 8 * _SCALE);
+
+    // If the cell's contents are unknown or its colours change, it all goes
+    if (((previous & 0xFF) == UNKNOWN_GLYPH) || ((previous >> 8) != attr))
+    {
+        _FRAMEBUFFER->plot_block(dx, dy,
+                        dx + (8 * _SCALE) - 1, dy + (8 * _SCALE) - 1,
+                        _CHARBUF, cellpixels);
+        _PIXELS_SENT += cellpixels;
+        return;
+    }
+
+    // Otherwise find which font pixels differ: the rows, and the columns of
+    // each row, most significant bit leftmost
+    uint8_t* before = &_FONT[(previous & 0xFF) * 8];
+    uint8_t* after = &_FONT[charindex * 8];
+    uint8_t diff[8];
+    uint8_t columns = 0;
+    int top = 8, bottom = 0, spans = 0;
+    uint32_t span_pixels = 0;
+    for (int r = 0; r < 8; r++)
+    {
+        diff[r] = before[r] ^ after[r];
+        if (diff[r])
+        {
+            if (top == 8)
+                top = r;
+            bottom = r;
+            columns |= diff[r];
+            spans++;
+            span_pixels += glyph_right(diff[r]) - glyph_left(diff[r]) + 1;
+        }
+    }
+
+    // Both glyphs are in the same colours, so if the bitmaps match (e.g. two
+    // characters mapped to the invalid glyph), nothing changes on screen
+    if (spans == 0)
+    {
+        _PIXELS_SAVED += cellpixels;
+        return;
+    }
+
+    // Choose between one window around every difference, and a window per
+    // differing row, by the bytes each would send
+    uint32_t scale2 = _SCALE * _SCALE;
+    uint32_t rect_pixels = (glyph_right(columns) - glyph_left(columns) + 1) * (bottom - top + 1);
+    uint32_t rect_cost = _WINDOW_COST + (rect_pixels * scale2 * sizeof(T));
+    uint32_t span_cost = (spans * _WINDOW_COST) + (span_pixels * scale2 * sizeof(T));
+
+    if (span_cost < rect_cost)
+    {
+        for (int r = top; r <= bottom; r++)
+        {
+            if (diff[r])
+                plot_region(dx, dy, glyph_left(diff[r]), glyph_right(diff[r]), r, r);
+        }
+        _PIXELS_SENT += span_pixels * scale2;
+        _PIXELS_SAVED += cellpixels - (span_pixels * scale2);
+    }
+    else
+    {
+        plot_region(dx, dy, glyph_left(columns), glyph_right(columns), top, bottom);
+        _PIXELS_SENT += rect_pixels * scale2;
+        _PIXELS_SAVED += cellpixels - (rect_pixels * scale2);
+    }
+}
+
+template <class T, class FB>
+void FBConsole<T, FB>::plot_region(uint16_t dx, uint16_t dy, uint8_t c0, uint8_t c1, uint8_t r0, uint8_t r1)
+{
+    // Pack the region of _CHARBUF (in font pixels) to the start of the
+    // buffer, then plot it. Rows are only ever moved towards the start, and
+    // the rows above the region are no longer needed, so this is in place.
+    uint16_t x0 = c0 * _SCALE, x1 = ((c1 + 1) * _SCALE) - 1;
+    uint16_t y0 = r0 * _SCALE, y1 = ((r1 + 1) * _SCALE) - 1;
+    uint32_t len = 0;
+    for (int y = y0; y <= y1; y++)
+    {
+        for (int x = x0; x <= x1; x++)
+            _CHARBUF[len++] = _CHARBUF[(y * 8 * _SCALE) + x];
+    }
+
+    _FRAMEBUFFER->plot_block(dx + x0, dy + y0, dx + x1, dy + y1, _CHARBUF, len);
+}
+
+template <class T, class FB>
+void FBConsole<T, FB>::get_stats(uint32_t* sent, uint32_t* saved)
+{
+    *sent = _PIXELS_SENT;
+    *saved = _PIXELS_SAVED;
+}
+
+template <class T, class FB>
+bool FBConsole<T, FB>::set_mirror(FBMirror* mirror)
+{
+    if (mirror && ((_WIDTH > 255) || (_HEIGHT > 255)))
+    {
+        _MIRROR = 0;
+        return false;
+    }
+
+    _MIRROR = mirror;
+    if (_MIRROR)
+        _MIRROR->request_sync();
+    return true;
+}
+
+template <class T, class FB>
+void FBConsole<T, FB>::mirror_flush()
+{
+    if (!_MIRROR)
+        return;
+
+    if (_MIRROR->needs_sync())
+        mirror_sync();
+    _MIRROR->flush();
+}
+
+template <class T, class FB>
+void FBConsole<T, FB>::mirror_sync()
+{
+    _MIRROR->begin_sync();
+    _MIRROR->geometry(_WIDTH, _HEIGHT);
+    for (int i = 0; i < _PALETTE_SIZE; i++)
+        _MIRROR->palette(i, _PALETTE[i]);
+
+    // Start from a blank screen, then send only the cells that aren't blank.
+    // Cells not yet drawn are sent as spaces.
+    _MIRROR->clear(console_attr);
+    for (int y = 0; y < _HEIGHT; y++)
+    {
+        for (int x = 0; x < _WIDTH; x++)
+        {
+            uint16_t c = *cell(x, y);
+            if ((c & 0xFF) == UNKNOWN_GLYPH)
+                c &= 0xFF00;
+            if (c != (console_attr << 8))
+                _MIRROR->cell(x, y, c & 0xFF, c >> 8);
+        }
+    }
+    _MIRROR->end_sync();
+}
+
+template <class T, class FB>
+bool FBConsole<T, FB>::cell_blank(uint16_t c, T black)
+{
+    uint8_t charindex = c & 0xFF;
+    uint8_t attr = c >> 8;
+    if (_PALETTE[attr & 0x0F] != black)
+        return false;
+    if ((charindex == UNKNOWN_GLYPH) || (_PALETTE[attr >> 4] == black))
+        return true;
+
+    for (int cy = 0; cy < 8; cy++)
+    {
+        if (_FONT[(charindex * 8) + cy])
+            return false;
+    }
+    return true;
+}
+
+template <class T, class FB>
+void FBConsole<T, FB>::report_text_rows()
+{
+    if (!_BOUND || !_TEXT_ROWS_STALE)
+        return;
+    _TEXT_ROWS_STALE = false;
+
+    T black = _FRAMEBUFFER->get_color(0x00, 0x00, 0x00);
+    int32_t top = -1;
+    int32_t bottom = -1;
+    for (int y = 0; y < _HEIGHT; y++)
+    {
+        for (int x = 0; x < _WIDTH; x++)
+        {
+            if (!cell_blank(*cell(x, y), black))
+            {
+                if (top < 0)
+                    top = y;
+                bottom = y;
+                break;
+            }
+        }
+    }
+
+    if (top < 0)
+        _FRAMEBUFFER->set_text_rows(-1, -1);
+    else
+        _FRAMEBUFFER->set_text_rows(top * 8 * _SCALE, ((bottom + 1) * 8 * _SCALE) - 1);
+}
+
+template <class T, class FB>
+void FBConsole<T, FB>::put_string(const char* str)
+{
+    int i = 0;
+    for (i = 0; str[i] != 0; i++)
+        put_char(str[i]);
+}
+
+template <class T, class FB>
+void FBConsole<T, FB>::clear()
+{
+    for (int i = 0; i < (_WIDTH * _HEIGHT); i++)
+        _CELLS[i] = (console_attr << 8);
+    _TEXT_ROWS_STALE = true;
+    console_x = 0;
+    console_y = 0;
+    if (_MIRROR)
+        _MIRROR->clear(console_attr);
+
+    if (_BOUND)
+        repaint();
+}
+
+template <class T, class FB>
+void FBConsole<T, FB>::set_location(uint16_t x, uint16_t y)
+{
+    if ((x < _WIDTH) && (y < _HEIGHT))
+    {
+        console_x = x;
+        console_y = y;
+    }
+}
+
+template <class T, class FB>
+bool FBConsole<T, FB>::set_background(T color)
+{
+    uint8_t index = palette_index(color);
+    if (index == PALETTE_FULL)
+        return false;
+
+    console_background = color;
+    console_attr = (console_attr & 0xF0) | index;
+    return true;
+}
+
+template <class T, class FB>
+bool FBConsole<T, FB>::set_foreground(T color)
+{
+    uint8_t index = palette_index(color);
+    if (index == PALETTE_FULL)
+        return false;
+
+    console_foreground = color;
+    console_attr = (index << 4) | (console_attr & 0x0F);
+    return true;
+}
+
+template <class T, class FB>
+void FBConsole<T, FB>::get_dimensions(uint16_t* width, uint16_t* height)
+{
+    *width = _WIDTH;
+    *height = _HEIGHT;
+}
+
+template <class T, class FB>
+void FBConsole<T, FB>::bind(FB* framebuffer)
+{
+    if (!_BOUND)
+        _ROWBUF = new T[row_pixels()];
+
+    _FRAMEBUFFER = framebuffer;
+    _BOUND = true;
+    _TEXT_ROWS_STALE = true;
+    repaint();
+}
+
+template <class T, class FB>
+void FBConsole<T, FB>::unbind()
+{
+    // Nothing is drawn while unbound, so the strip can go until the next bind
+    if (_BOUND)
+    {
+        delete[] _ROWBUF;
+        _ROWBUF = 0;
+    }
+    _BOUND = false;
+}
+
+template <class T, class FB>
+uint32_t FBConsole<T, FB>::row_pixels()
+{
+    return (_WIDTH * 8 * _SCALE) * (8 * _SCALE);
+}
+
+template <class T, class FB>
+void FBConsole<T, FB>::repaint()
+{
+    if (!_BOUND)
+        return;
+
+    // Render a full row of characters at a time, so each row is one block
+    uint32_t stride = _WIDTH * 8 * _SCALE;
+
+    for (int y = 0; y < _HEIGHT; y++)
+    {
+        for (int x = 0; x < _WIDTH; x++)
+        {
+            // Cells not yet drawn are painted as spaces, and are known from now on
+            uint16_t* c = cell(x, y);
+            if ((*c & 0xFF) == UNKNOWN_GLYPH)
+                *c &= 0xFF00;
+            render_glyph(*c & 0xFF, *c >> 8, &_ROWBUF[x * 8 * _SCALE], stride);
+        }
+
+        uint16_t dy = (y * 8 * _SCALE);
+        _FRAMEBUFFER->plot_block(0, dy, stride - 1, dy + (8 * _SCALE) - 1,
+                                 _ROWBUF, stride * 8 * _SCALE);
+        _PIXELS_SENT += stride * 8 * _SCALE;
+    }
+}
+
+#endif
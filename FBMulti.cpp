@@ -0,0 +1,126 @@
+// Copyright 2021 Dominic Houghton. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Composite framebuffer, mirroring one I_Framebuffer onto several others
+
+#include "FBMulti.hpp"
+
+template <class T>
+FBMulti<T>::FBMulti(I_Framebuffer<T>** framebuffers, uint8_t count)
+{
+    uint16_t width, height;
+
+    // Keep our own copy of the list, so the caller may use a temporary array
+    _FRAMEBUFFERS = new I_Framebuffer<T>*[count];
+    _COUNT = count;
+    for (int i = 0; i < _COUNT; i++)
+        _FRAMEBUFFERS[i] = framebuffers[i];
+
+    // Use the smallest area every display can show
+    _WIDTH = 0xFFFF;
+    _HEIGHT = 0xFFFF;
+    _BLANK_WIDTH = 0;
+    for (int i = 0; i < _COUNT; i++)
+    {
+        _FRAMEBUFFERS[i]->get_dimensions(&width, &height);
+        if (width < _WIDTH)
+            _WIDTH = width;
+        if (height < _HEIGHT)
+            _HEIGHT = height;
+        if (width > _BLANK_WIDTH)
+            _BLANK_WIDTH = width;
+    }
+
+    // Taller displays have rows the console never draws; keep them black
+    _BLANK = new T[_BLANK_WIDTH];
+    T black = get_color(0, 0, 0);
+    for (int x = 0; x < _BLANK_WIDTH; x++)
+        _BLANK[x] = black;
+    for (int i = 0; i < _COUNT; i++)
+        clear_below(i, 0xFFFF);
+}
+
+template <class T>
+FBMulti<T>::~FBMulti()
+{
+    delete[] _FRAMEBUFFERS;
+    delete[] _BLANK;
+}
+
+// Clears up to the bottom rows of a backend, but none of the common area
+template <class T>
+void FBMulti<T>::clear_below(uint8_t index, uint16_t rows)
+{
+    uint16_t width, height;
+    _FRAMEBUFFERS[index]->get_dimensions(&width, &height);
+    if (height <= _HEIGHT)
+        return;
+
+    uint16_t y0 = (rows < (height - _HEIGHT)) ? (height - rows) : _HEIGHT;
+    for (uint16_t y = y0; y < height; y++)
+        _FRAMEBUFFERS[index]->plot_block(0, y, width - 1, y, _BLANK, width);
+}
+
+template <class T>
+T FBMulti<T>::get_color(uint8_t r, uint8_t g, uint8_t b)
+{
+    return _FRAMEBUFFERS[0]->get_color(r, g, b);
+}
+
+template <class T>
+void FBMulti<T>::get_dimensions(uint16_t* width, uint16_t* height)
+{
+    *width = _WIDTH;
+    *height = _HEIGHT;
+}
+
+template <class T>
+void FBMulti<T>::plot_block(uint16_t x0, uint16_t y0,
+                            uint16_t x1, uint16_t y1,
+                            T* pixeldata, uint32_t len)
+{
+    // Start the block on every display, then wait for all of them, so that
+    // displays on separate buses transfer in parallel
+    plot_block_async(x0, y0, x1, y1, pixeldata, len);
+    wait_idle();
+}
+
+template <class T>
+void FBMulti<T>::plot_block_async(uint16_t x0, uint16_t y0,
+                                  uint16_t x1, uint16_t y1,
+                                  T* pixeldata, uint32_t len)
+{
+    for (int i = 0; i < _COUNT; i++)
+        _FRAMEBUFFERS[i]->plot_block_async(x0, y0, x1, y1, pixeldata, len);
+}
+
+template <class T>
+void FBMulti<T>::wait_idle()
+{
+    for (int i = 0; i < _COUNT; i++)
+        _FRAMEBUFFERS[i]->wait_idle();
+}
+
+template <class T>
+void FBMulti<T>::scroll_vertical(uint16_t pixels)
+{
+    // Each display tracks its own scroll offset. A taller display has
+    // rotated rows from the top of the console into its bottom rows.
+    for (int i = 0; i < _COUNT; i++)
+    {
+        _FRAMEBUFFERS[i]->scroll_vertical(pixels);
+        clear_below(i, pixels);
+    }
+}
+
+template <class T>
+void FBMulti<T>::set_text_rows(int32_t top, int32_t bottom)
+{
+    for (int i = 0; i < _COUNT; i++)
+        _FRAMEBUFFERS[i]->set_text_rows(top, bottom);
+}
+
+template class FBMulti<uint8_t>;
+template class FBMulti<uint16_t>;
+template class FBMulti<uint32_t>;
@@ -0,0 +1,67 @@
+// Copyright 2021 Dominic Houghton. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+/* Composite framebuffer, mirroring one I_Framebuffer onto several others
+
+ * Every call is forwarded to each backend, so a single FBConsole rasterizes
+ * each glyph once and the resulting block is sent to every display.
+ * 
+ * plot_block starts the block on every backend with plot_block_async before
+ * waiting for any of them, so backends on independent buses (e.g. ILI9341s on
+ * spi0 and spi1) transfer at the same time.
+ * 
+ * Each backend keeps its own scroll state; plot_block coordinates are always
+ * logical, so backends are free to implement scroll_vertical differently.
+ * 
+ * All backends are expected to share the same pixel format; get_color is
+ * answered by the first backend. The reported dimensions are the smallest
+ * common to all backends.
+ * 
+ * Backends may differ in size. The console never draws outside the common
+ * area, but a taller backend scrolls over its full height, which would bring
+ * the console's top rows round into the area below it. scroll_vertical clears
+ * the rows that scrolled in there on each taller backend, so it stays black.
+ */
+
+#ifndef FBMULTI_H
+#define FBMULTI_H
+
+#include "I_Framebuffer.hpp"
+
+template <class T>
+class FBMulti : public I_Framebuffer<T> {
+    public:
+        FBMulti(I_Framebuffer<T>** framebuffers, uint8_t count);
+        ~FBMulti();
+        FBMulti(const FBMulti&) = delete;
+        FBMulti& operator=(const FBMulti&) = delete;
+
+        T get_color(uint8_t r, uint8_t g, uint8_t b);
+        void get_dimensions(uint16_t* width, uint16_t* height);
+
+        void plot_block(uint16_t x0, uint16_t y0,
+                        uint16_t x1, uint16_t y1,
+                        T* pixeldata, uint32_t len);
+        void plot_block_async(uint16_t x0, uint16_t y0,
+                              uint16_t x1, uint16_t y1,
+                              T* pixeldata, uint32_t len);
+        void wait_idle();
+
+        void scroll_vertical(uint16_t pixels);
+        void set_text_rows(int32_t top, int32_t bottom);
+
+    private:
+        void clear_below(uint8_t index, uint16_t rows);
+
+        I_Framebuffer<T>** _FRAMEBUFFERS;
+        uint8_t _COUNT;
+        uint16_t _WIDTH;
+        uint16_t _HEIGHT;
+
+        // One row of black, wide enough for the widest backend
+        T* _BLANK;
+        uint16_t _BLANK_WIDTH;
+};
+
+#endif
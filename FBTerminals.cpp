@@ -0,0 +1,13 @@
+// Copyright 2021 Dominic Houghton. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Virtual terminals, sharing a single framebuffer
+
+#include "FBTerminals_impl.hpp"
+
+// Virtually dispatched, for any I_Framebuffer. Drivers instantiate their own
+// statically dispatched variants.
+template class FBTerminals<uint8_t>;
+template class FBTerminals<uint16_t>;
+template class FBTerminals<uint32_t>;
@@ -0,0 +1,43 @@
+// Copyright 2021 Dominic Houghton. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+/* Virtual terminals, sharing a single framebuffer
+
+ * Holds a number of FBConsole instances, of which only the active one is
+ * bound to the framebuffer. The others keep accepting output into their cell
+ * state without touching the display. Switching terminal repaints the screen
+ * from the new terminal's cell state, rather than replaying its output. Only
+ * the active terminal holds a repaint strip, so each extra terminal costs
+ * just its cells.
+ */
+
+#ifndef FBTERMINALS_H
+#define FBTERMINALS_H
+
+#include "FBConsole.hpp"
+
+template <class T, class FB = I_Framebuffer<T>>
+class FBTerminals {
+    public:
+        FBTerminals(FB* framebuffer, uint8_t* font, uint8_t count, uint8_t scale = 1);
+        ~FBTerminals();
+        FBTerminals(const FBTerminals&) = delete;
+        FBTerminals& operator=(const FBTerminals&) = delete;
+
+        // Returns terminal n, or the active terminal if n is out of range
+        FBConsole<T, FB>* get(uint8_t n);
+        FBConsole<T, FB>* get_active();
+
+        void switch_to(uint8_t n);
+        uint8_t get_active_index();
+        uint8_t get_count();
+
+    private:
+        FB* _FRAMEBUFFER;
+        FBConsole<T, FB>** _TERMINALS;
+        uint8_t _COUNT;
+        uint8_t _ACTIVE;
+};
+
+#endif
@@ -0,0 +1,76 @@
+// Copyright 2021 Dominic Houghton. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Virtual terminals, sharing a single framebuffer: template definitions.
+// Included where FBTerminals is explicitly instantiated, like FBConsole_impl.hpp.
+
+#ifndef FBTERMINALS_IMPL_H
+#define FBTERMINALS_IMPL_H
+
+#include "FBTerminals.hpp"
+#include "FBConsole_impl.hpp"
+
+template <class T, class FB>
+FBTerminals<T, FB>::FBTerminals(FB* framebuffer, uint8_t* font, uint8_t count, uint8_t scale)
+{
+    _FRAMEBUFFER = framebuffer;
+    _COUNT = count;
+    _ACTIVE = 0;
+
+    // Create every terminal, leaving only the first bound to the framebuffer
+    _TERMINALS = new FBConsole<T, FB>*[_COUNT];
+    for (int i = 0; i < _COUNT; i++)
+    {
+        _TERMINALS[i] = new FBConsole<T, FB>(_FRAMEBUFFER, font, scale);
+        if (i != _ACTIVE)
+            _TERMINALS[i]->unbind();
+    }
+}
+
+template <class T, class FB>
+FBTerminals<T, FB>::~FBTerminals()
+{
+    for (int i = 0; i < _COUNT; i++)
+        delete _TERMINALS[i];
+    delete[] _TERMINALS;
+}
+
+template <class T, class FB>
+FBConsole<T, FB>* FBTerminals<T, FB>::get(uint8_t n)
+{
+    if (n >= _COUNT)
+        return _TERMINALS[_ACTIVE];
+    return _TERMINALS[n];
+}
+
+template <class T, class FB>
+FBConsole<T, FB>* FBTerminals<T, FB>::get_active()
+{
+    return _TERMINALS[_ACTIVE];
+}
+
+template <class T, class FB>
+void FBTerminals<T, FB>::switch_to(uint8_t n)
+{
+    if ((n >= _COUNT) || (n == _ACTIVE))
+        return;
+
+    _TERMINALS[_ACTIVE]->unbind();
+    _ACTIVE = n;
+    _TERMINALS[_ACTIVE]->bind(_FRAMEBUFFER);
+}
+
+template <class T, class FB>
+uint8_t FBTerminals<T, FB>::get_active_index()
+{
+    return _ACTIVE;
+}
+
+template <class T, class FB>
+uint8_t FBTerminals<T, FB>::get_count()
+{
+    return _COUNT;
+}
+
+#endif
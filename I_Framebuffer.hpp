@@ -18,6 +18,22 @@
  * addressing modes provided by the display driver and keeping an offset. See
  * StereoRocker's implementation of the ili9341 framebuffer for an example of
  * using addressing modes provided by the chip.
+ * 
+ * plot_block_async and wait_idle are optional. plot_block_async may return
+ * while the pixel data is still being read (e.g. by DMA), and the caller must
+ * call wait_idle before modifying or freeing that data. The default
+ * implementations simply call plot_block and return immediately.
+ * 
+ * plot_glyph is optional, allowing drivers with packed pixel formats to draw
+ * an 8x8 font glyph (one byte per row, most significant bit leftmost) without
+ * it first being expanded to one T per pixel. It returns false if the driver
+ * can't draw the glyph directly, in which case the caller falls back to
+ * plot_block. The default implementation always returns false.
+ * 
+ * set_text_rows is an optional hint from the client, giving the range of
+ * pixel rows (logical, as for plot_block) that show anything but black, or -1
+ * for both if none do. A driver may use it to stop refreshing the others,
+ * e.g. with a display's partial mode. The default implementation ignores it.
  */
 
 #ifndef I_FRAMEBUFFER_H
@@ -28,15 +44,32 @@
 template<class T>
 class I_Framebuffer {
     public:
-        virtual T get_color(uint8_t r, uint8_t g, uint8_t b);
+        virtual T get_color(uint8_t r, uint8_t g, uint8_t b) = 0;
         
-        virtual void get_dimensions(uint16_t* width, uint16_t* height);
+        virtual void get_dimensions(uint16_t* width, uint16_t* height) = 0;
 
         virtual void plot_block(uint16_t x0, uint16_t y0,
                                 uint16_t x1, uint16_t y1,
-                                T* pixeldata, uint32_t len);
+                                T* pixeldata, uint32_t len) = 0;
         
-        virtual void scroll_vertical(uint16_t pixels);
+        virtual void scroll_vertical(uint16_t pixels) = 0;
+
+        virtual void plot_block_async(uint16_t x0, uint16_t y0,
+                                      uint16_t x1, uint16_t y1,
+                                      T* pixeldata, uint32_t len)
+        {
+            plot_block(x0, y0, x1, y1, pixeldata, len);
+        }
+
+        virtual void wait_idle() {}
+
+        virtual bool plot_glyph(uint16_t x, uint16_t y, const uint8_t* glyph,
+                                uint8_t scale, T foreground, T background)
+        {
+            return false;
+        }
+
+        virtual void set_text_rows(int32_t top, int32_t bottom) {}
 };
 
 #endif
\ No newline at end of file
@@ -8,11 +8,115 @@
 #include "FBConsole.hpp"
 #include "pico/stdio/driver.h"
 #include "pico/stdio.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+#include "pico/time.h"
 
 #include "ili9341.hpp"
+#include "FBMulti.hpp"
 #include "gamefont.hpp"
+#include "fbtrace.hpp"
+#include "fbmirror.hpp"
 
-FBConsole<uint16_t> *fb;
+#if LIB_PICO_STDIO_USB
+#include "pico/stdio_usb.h"
+#endif
+
+#include <type_traits>
+
+// ILI9341 pin definitions:
+// Each entry describes one display. Displays on separate SPI instances are
+// driven in parallel; displays sharing an SPI instance need their own CS & DC.
+// Pins can be changed, see the GPIO function select table in the datasheet
+// for information on GPIO assignments.
+struct fb_display {
+    spi_inst_t* spi;
+    uint8_t miso;
+    uint8_t mosi;
+    uint8_t sck;
+    uint8_t cs;
+    uint8_t dc;
+    uint8_t rst;
+};
+
+const fb_display FB_DISPLAYS[] = {
+    // SPI      MISO MOSI SCK  CS   DC   RST
+    {  spi0,    4,   7,   6,   27,  26,  22  },
+    // Uncomment to mirror the console onto a second display on spi1
+    //{  spi1,    12,  11,  10,  13,  14,  15  },
+};
+
+constexpr unsigned int FB_DISPLAY_COUNT = sizeof(FB_DISPLAYS) / sizeof(FB_DISPLAYS[0]);
+
+// Every display is the same panel, driven with these settings
+#define FB_PANEL_WIDTH      240
+#define FB_PANEL_HEIGHT     320
+#define FB_PANEL_ROTATION   0
+#define FB_PANEL_BAUDRATE   (25*1000*1000)
+
+// With a single display, the console calls the ILI9341 driver directly rather
+// than through the I_Framebuffer virtual interface. Several displays go
+// through FBMulti, which needs the virtual interface.
+typedef std::conditional<FB_DISPLAY_COUNT == 1, ILI9341, I_Framebuffer<uint16_t>>::type fb_backend_t;
+typedef FBConsole<uint16_t, fb_backend_t> fb_console_t;
+
+// SPI clock calibration:
+// On first boot, each display's SPI clock is calibrated between these limits,
+// and the results stored in the last sector of flash for later boots. The
+// results are only used while FB_DISPLAYS and the panel settings are the
+// same, so rewiring calibrates again. Calibration needs MISO connected, and
+// overwrites the last sector of flash, so it is off unless the build enables
+// it (cmake -DFB_CALIBRATE=ON).
+#ifndef FB_CALIBRATE
+#define FB_CALIBRATE        0
+#endif
+#define FB_CALIBRATE_MIN    (10*1000*1000)
+#define FB_CALIBRATE_MAX    (63*1000*1000)
+#define FB_CALIBRATE_STEP   (1*1000*1000)
+#define FB_CALIBRATE_MAGIC  0x46424332  // "FBC2"
+#define FB_CALIBRATE_OFFSET (PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE)
+
+struct fb_calibration {
+    uint32_t magic;
+    uint32_t displays;      // fb_displays_hash() when calibrated
+    uint32_t baudrate[FB_DISPLAY_COUNT];
+    uint32_t check;
+};
+
+// Power management:
+// After these periods without output, the displays scan only the rows with
+// text on, then drop to 8 colour idle mode, then sleep. The next output wakes
+// them. Set any to 0 to disable that stage.
+#define FB_PARTIAL_MS   (5*1000)
+#define FB_IDLE_MS      (30*1000)
+#define FB_SLEEP_MS     (10*60*1000)
+
+// Screen mirroring:
+// Changes to the console are sent over USB stdio as a compact stream, which
+// tools/fbmirror_view.py shows on the host. Changes are batched and sent every
+// FB_MIRROR_MS from fb_poll; the whole screen is resent every FB_MIRROR_SYNC_MS
+// for viewers that connect later, or sooner if more changes than fit in
+// FB_MIRROR_BUFFER bytes arrive between sends. The stream is mixed in with
+// ordinary stdio output, so it is off unless the build enables it
+// (cmake -DFB_MIRROR=ON), which needs USB stdio.
+#ifndef FB_MIRROR
+#define FB_MIRROR           0
+#endif
+#if FB_MIRROR && !LIB_PICO_STDIO_USB
+#error "FB_MIRROR needs USB stdio"
+#endif
+#define FB_MIRROR_MS        50
+#define FB_MIRROR_SYNC_MS   (10*1000)
+#define FB_MIRROR_BUFFER    1024
+
+fb_console_t *fb;
+ILI9341* display[FB_DISPLAY_COUNT];
+
+#if FB_MIRROR
+FBMirror* mirror;
+uint32_t fb_mirror_flushed;
+uint32_t fb_mirror_synced;
+#endif
 
 // FBConsole specific
 void fb_out_chars(const char *buf, int len)
@@ -33,27 +137,201 @@ stdio_driver_t stdio_fb = {
 
 };
 
+#if FB_CALIBRATE
+// FNV-1a over the wiring and panel settings of every display
+static uint32_t fb_displays_hash()
+{
+    const uint32_t settings[] = { FB_PANEL_WIDTH, FB_PANEL_HEIGHT, FB_PANEL_ROTATION, FB_PANEL_BAUDRATE };
+    uint32_t hash = 2166136261u;
+    auto add = [&hash](uint32_t value) {
+        for (int i = 0; i < 4; i++)
+            hash = (hash ^ ((value >> (i * 8)) & 0xFF)) * 16777619u;
+    };
 
-// ILI9341 pin definitions:
-// We are going to use SPI 0, and allocate it to the following GPIO pins.
-// Pins can be changed, see the GPIO function select table in the datasheet
-// for information on GPIO assignments.
-#define SPI_PORT spi0
-#define PIN_MISO 4
-#define PIN_SCK  6
-#define PIN_MOSI 7
-#define PIN_CS   27
-#define PIN_DC   26
-#define PIN_RST  22
+    for (uint32_t setting : settings)
+        add(setting);
+    for (unsigned int i = 0; i < FB_DISPLAY_COUNT; i++)
+    {
+        const fb_display& d = FB_DISPLAYS[i];
+        add(spi_get_index(d.spi));
+        add((d.miso << 24) | (d.mosi << 16) | (d.sck << 8) | d.cs);
+        add((d.dc << 8) | d.rst);
+    }
+    return hash;
+}
+
+static uint32_t fb_calibration_check(const fb_calibration* calibration)
+{
+    uint32_t check = calibration->magic ^ calibration->displays;
+    for (unsigned int i = 0; i < FB_DISPLAY_COUNT; i++)
+        check ^= calibration->baudrate[i];
+    return ~check;
+}
+
+// Returns the stored calibration, or 0 if there isn't a valid one
+static const fb_calibration* fb_load_calibration()
+{
+    const fb_calibration* calibration = (const fb_calibration*)(XIP_BASE + FB_CALIBRATE_OFFSET);
+    if ((calibration->magic != FB_CALIBRATE_MAGIC) ||
+        (calibration->displays != fb_displays_hash()) ||
+        (calibration->check != fb_calibration_check(calibration)))
+        return 0;
+    return calibration;
+}
+
+static void fb_save_calibration(const uint32_t* baudrate)
+{
+    uint8_t page[FLASH_PAGE_SIZE] = {0};
+    fb_calibration* calibration = (fb_calibration*)page;
+
+    calibration->magic = FB_CALIBRATE_MAGIC;
+    calibration->displays = fb_displays_hash();
+    for (unsigned int i = 0; i < FB_DISPLAY_COUNT; i++)
+        calibration->baudrate[i] = baudrate[i];
+    calibration->check = fb_calibration_check(calibration);
 
-ILI9341* display;
+    // Nothing may run from flash while it is being written
+    uint32_t interrupts = save_and_disable_interrupts();
+    flash_range_erase(FB_CALIBRATE_OFFSET, FLASH_SECTOR_SIZE);
+    flash_range_program(FB_CALIBRATE_OFFSET, page, FLASH_PAGE_SIZE);
+    restore_interrupts(interrupts);
+}
+#endif
+
+// The framebuffer the console draws to: the display itself, or an FBMulti
+// over all of them
+template <class FB>
+static FB* fb_backend()
+{
+    if constexpr (std::is_same<FB, ILI9341>::value)
+    {
+        return display[0];
+    }
+    else
+    {
+        I_Framebuffer<uint16_t>* backends[FB_DISPLAY_COUNT];
+        for (unsigned int i = 0; i < FB_DISPLAY_COUNT; i++)
+            backends[i] = display[i];
+        return new FBMulti<uint16_t>(backends, FB_DISPLAY_COUNT);
+    }
+}
 
 void fb_setup()
 {
-    display = new ILI9341(SPI_PORT, PIN_MISO, PIN_MOSI, PIN_SCK,
-                            PIN_CS, PIN_DC, PIN_RST);
+    // The displays aren't cleared on reset, as the console paints every cell
+    // once it is attached (and calibration clears them after its patterns)
+    for (unsigned int i = 0; i < FB_DISPLAY_COUNT; i++)
+    {
+        display[i] = new ILI9341(FB_DISPLAYS[i].spi, FB_DISPLAYS[i].miso,
+                            FB_DISPLAYS[i].mosi, FB_DISPLAYS[i].sck,
+                            FB_DISPLAYS[i].cs, FB_DISPLAYS[i].dc,
+                            FB_DISPLAYS[i].rst, FB_PANEL_WIDTH, FB_PANEL_HEIGHT,
+                            FB_PANEL_ROTATION, FB_PANEL_BAUDRATE, false);
+    }
 
-    fb = new FBConsole<uint16_t>(display, (uint8_t*)&font);
+#if FB_CALIBRATE
+    const fb_calibration* calibration = fb_load_calibration();
+    if (calibration)
+    {
+        for (unsigned int i = 0; i < FB_DISPLAY_COUNT; i++)
+            display[i]->set_baudrate(calibration->baudrate[i]);
+    }
+    else
+    {
+        uint32_t baudrate[FB_DISPLAY_COUNT];
+        bool calibrated = true;
+        for (unsigned int i = 0; i < FB_DISPLAY_COUNT; i++)
+        {
+            baudrate[i] = display[i]->calibrate(FB_CALIBRATE_MIN, FB_CALIBRATE_MAX, FB_CALIBRATE_STEP);
+            if (baudrate[i] == 0)
+                calibrated = false;
+        }
+
+        // Only store a complete result, so a display without MISO is retried next boot
+        if (calibrated)
+            fb_save_calibration(baudrate);
+    }
+#endif
+
+    for (unsigned int i = 0; i < FB_DISPLAY_COUNT; i++)
+        display[i]->set_power_timeouts(FB_PARTIAL_MS, FB_IDLE_MS, FB_SLEEP_MS);
+
+    // The panel is a whole number of cells, so this covers the whole of display RAM
+    fb = new fb_console_t(fb_backend<fb_backend_t>(), (uint8_t*)&font);
+    fb->repaint();
+
+#if FB_MIRROR
+    // Colours are byte-swapped RGB565, as the displays aren't in native endian mode
+    mirror = new FBMirror(stdio_usb.out_chars, FBMIRROR_RGB565_SWAPPED, FB_MIRROR_BUFFER);
+    fb->set_mirror(mirror);
+    fb_mirror_flushed = fb_mirror_synced = to_ms_since_boot(get_absolute_time());
+#endif
 
     stdio_set_driver_enabled(&stdio_fb, true);
+}
+
+
+void fb_poll()
+{
+    // Partial mode scans only the rows the console has text on
+    fb->report_text_rows();
+    for (unsigned int i = 0; i < FB_DISPLAY_COUNT; i++)
+        display[i]->power_tick();
+
+#if FB_MIRROR
+    uint32_t now = to_ms_since_boot(get_absolute_time());
+    if ((now - fb_mirror_synced) >= FB_MIRROR_SYNC_MS)
+    {
+        mirror->request_sync();
+        fb_mirror_synced = now;
+    }
+    if ((now - fb_mirror_flushed) >= FB_MIRROR_MS)
+    {
+        fb->mirror_flush();
+        fb_mirror_flushed = now;
+    }
+#endif
+}
+
+uint32_t fb_first_pixel_us()
+{
+    return display[0]->get_first_pixel_us();
+}
+
+uint32_t fb_wake_latency_us()
+{
+    uint32_t latency = 0;
+    for (unsigned int i = 0; i < FB_DISPLAY_COUNT; i++)
+        latency = MAX(latency, display[i]->get_wake_latency_us());
+    return latency;
+}
+
+void fb_get_stats(uint32_t* sent, uint32_t* saved)
+{
+    fb->get_stats(sent, saved);
+}
+
+uint32_t fb_pixel_bytes()
+{
+    uint32_t bytes = 0;
+    for (unsigned int i = 0; i < FB_DISPLAY_COUNT; i++)
+        bytes += display[i]->get_pixel_bytes();
+    return bytes;
+}
+
+void fb_mirror_stats(uint32_t* updates, uint32_t* bytes)
+{
+#if FB_MIRROR
+    mirror->get_stats(updates, bytes);
+#else
+    *updates = 0;
+    *bytes = 0;
+#endif
+}
+
+void fb_trace_dump()
+{
+#if defined(FBTRACE_ENABLED) && LIB_PICO_STDIO_USB
+    fbtrace_dump(stdio_usb.out_chars);
+#endif
 }
\ No newline at end of file
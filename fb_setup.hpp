@@ -5,6 +5,32 @@
 #ifndef FB_SETUP_H
 #define FB_SETUP_H
 
+#include <stdint.h>
+
 void fb_setup();
 
+// Housekeeping for the displays, such as power management and sending the
+// screen mirror; call regularly
+void fb_poll();
+
+// Microseconds from starting display bring-up to the first pixel being sent
+uint32_t fb_first_pixel_us();
+
+// Worst time any display has taken to wake from a power saving mode before drawing, in microseconds
+uint32_t fb_wake_latency_us();
+
+// Pixels the console has sent, and pixels saved by redrawing only what changed
+void fb_get_stats(uint32_t* sent, uint32_t* saved);
+
+// Bytes of pixel data sent over SPI to all displays, in their wire format
+uint32_t fb_pixel_bytes();
+
+// Console changes reported to the screen mirror, and bytes it has sent.
+// Both are 0 if mirroring is disabled.
+void fb_mirror_stats(uint32_t* updates, uint32_t* bytes);
+
+// Writes the display trace ring over USB stdio, bypassing the console.
+// Does nothing unless built with FBTRACE_ENABLED.
+void fb_trace_dump();
+
 #endif
\ No newline at end of file
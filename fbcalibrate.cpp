@@ -0,0 +1,39 @@
+// Copyright 2021 Dominic Houghton. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Bus clock calibration
+
+#include "fbcalibrate.hpp"
+
+uint32_t fbcalibrate(FBCalibrate_Bus* bus, uint32_t min_baudrate, uint32_t max_baudrate,
+                     uint32_t step, uint8_t margin_percent)
+{
+    uint32_t best = 0;
+    uint32_t last = 0;
+
+    // A step of 0 tries min_baudrate alone
+    if (step == 0)
+    {
+        step = 1;
+        max_baudrate = min_baudrate;
+    }
+
+    // Counted in 64 bits, so a range ending near UINT32_MAX doesn't wrap
+    for (uint64_t baudrate = min_baudrate; baudrate <= max_baudrate; baudrate += step)
+    {
+        // Skip requests that round to a rate we've already tried
+        uint32_t actual = bus->set_baudrate(baudrate);
+        if (actual == last)
+            continue;
+        last = actual;
+
+        if (!bus->write_readback())
+            break;
+        best = actual;
+    }
+
+    if (best == 0)
+        return 0;
+    return bus->set_baudrate(best - ((best / 100) * margin_percent));
+}
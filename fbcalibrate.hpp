@@ -0,0 +1,36 @@
+// Copyright 2021 Dominic Houghton. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+/* Bus clock calibration
+
+ * fbcalibrate searches for the fastest clock at which a bus transfers data
+ * reliably. It knows nothing of the hardware; the bus is reached through a
+ * FBCalibrate_Bus, so the search can be tested on the host against a
+ * simulated bus.
+ * 
+ * The search steps up from min_baudrate (a step of 0 tries only that). Clock dividers only give certain
+ * rates, so requests that give a rate already tried are skipped. Errors get
+ * worse with clock speed, so the search stops at the first rate that fails.
+ * The fastest rate that passed, less margin_percent, is set on the bus and
+ * returned. If min_baudrate fails, 0 is returned and the bus is left at the
+ * rate that failed, for the caller to restore.
+ */
+
+#ifndef FBCALIBRATE_H
+#define FBCALIBRATE_H
+
+#include <stdint.h>
+
+class FBCalibrate_Bus {
+    public:
+        // Sets the clock as near baudrate as the bus allows, returning the rate actually set
+        virtual uint32_t set_baudrate(uint32_t baudrate) = 0;
+        // Writes test data at the current clock and reads it back; false if any of it differs
+        virtual bool write_readback() = 0;
+};
+
+uint32_t fbcalibrate(FBCalibrate_Bus* bus, uint32_t min_baudrate, uint32_t max_baudrate,
+                     uint32_t step, uint8_t margin_percent);
+
+#endif
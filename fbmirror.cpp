@@ -0,0 +1,265 @@
+// Copyright 2021 Dominic Houghton. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Compact stream of console changes, for mirroring the screen to a host
+
+#include "fbmirror.hpp"
+
+FBMirror::FBMirror(void (*out_chars)(const char* buf, int len), uint8_t format, uint16_t buffer_size)
+{
+    _OUT_CHARS = out_chars;
+    _FORMAT = format;
+    _SIZE = buffer_size;
+    _BUFFER = new uint8_t[_SIZE];
+    _LEN = HEADER_BYTES;
+
+    _WIDTH = 0;
+    _CURSOR_X = 0;
+    _CURSOR_Y = 0;
+    _ATTR = 0;
+    _RUN = 0;
+    _REPEAT = false;
+
+    // Nothing has been sent yet, so the first flush sends the whole screen
+    _SYNC_NEEDED = true;
+    _SYNCING = false;
+
+    _UPDATES = 0;
+    _BYTES = 0;
+}
+
+FBMirror::~FBMirror()
+{
+    delete[] _BUFFER;
+}
+
+bool FBMirror::reserve()
+{
+    if (_SYNC_NEEDED)
+        return false;
+
+    // Room for the change and the checksum
+    if ((_LEN + MAX_CHANGE_BYTES + 1) <= _SIZE)
+        return true;
+
+    if (_SYNCING)
+    {
+        flush();
+        return true;
+    }
+
+    // Too much changed since the last flush; resending the screen is cheaper
+    _LEN = HEADER_BYTES;
+    _RUN = 0;
+    _SYNC_NEEDED = true;
+    return false;
+}
+
+void FBMirror::put(uint8_t byte)
+{
+    _BUFFER[_LEN++] = byte;
+}
+
+void FBMirror::geometry(uint8_t width, uint8_t height)
+{
+    if (!reserve())
+        return;
+
+    _RUN = 0;
+    put(OP_GEOMETRY);
+    put(width);
+    put(height);
+    put(_FORMAT);
+
+    _WIDTH = width;
+    _CURSOR_X = 0;
+    _CURSOR_Y = 0;
+    _ATTR = 0;
+}
+
+void FBMirror::palette(uint8_t index, uint32_t color)
+{
+    if (!reserve())
+        return;
+
+    _RUN = 0;
+    put(OP_PALETTE);
+    put(index);
+    for (int i = 0; i < 4; i++)
+        put(color >> (i * 8));
+}
+
+void FBMirror::clear(uint8_t attr)
+{
+    if (!reserve())
+        return;
+    if (!_SYNCING)
+        _UPDATES++;
+
+    _RUN = 0;
+    put(OP_CLEAR);
+    put(attr);
+    _CURSOR_X = 0;
+    _CURSOR_Y = 0;
+}
+
+void FBMirror::scroll(uint8_t attr)
+{
+    if (!reserve())
+        return;
+    if (!_SYNCING)
+        _UPDATES++;
+
+    _RUN = 0;
+    put(OP_SCROLL);
+    put(attr);
+    if (_CURSOR_Y > 0)
+        _CURSOR_Y--;
+}
+
+void FBMirror::cell(uint8_t x, uint8_t y, uint8_t glyph, uint8_t attr)
+{
+    if (!reserve())
+        return;
+    if (!_SYNCING)
+        _UPDATES++;
+
+    if (attr != _ATTR)
+    {
+        _RUN = 0;
+        put(OP_ATTR);
+        put(attr);
+        _ATTR = attr;
+    }
+
+    // Only say where the cell is if it isn't where the last one left off
+    if ((x != _CURSOR_X) || (y != _CURSOR_Y))
+    {
+        _RUN = 0;
+        if ((x == 0) && (y == _CURSOR_Y + 1))
+        {
+            put(OP_NEWLINE);
+        }
+        else
+        {
+            put(OP_GOTO);
+            put(x);
+            put(y);
+        }
+    }
+
+    append_glyph(glyph);
+
+    _CURSOR_X = x + 1;
+    _CURSOR_Y = y;
+    if (_CURSOR_X >= _WIDTH)
+    {
+        _CURSOR_X = 0;
+        _CURSOR_Y++;
+    }
+}
+
+void FBMirror::append_glyph(uint8_t glyph)
+{
+    if (_RUN && _REPEAT)
+    {
+        // Extend the repeat if it's the same glyph again
+        if ((_BUFFER[_RUN + 2] == glyph) && (_BUFFER[_RUN + 1] < 0xFF))
+        {
+            _BUFFER[_RUN + 1]++;
+            return;
+        }
+        _RUN = 0;
+    }
+
+    if (_RUN)
+    {
+        uint8_t count = _BUFFER[_RUN] & 0x7F;
+
+        // A third identical glyph turns the end of the literal into a repeat
+        if ((count >= 2) && (_BUFFER[_LEN - 1] == glyph) && (_BUFFER[_LEN - 2] == glyph))
+        {
+            _LEN -= 2;
+            count -= 2;
+            if (count == 0)
+                _LEN = _RUN;
+            else
+                _BUFFER[_RUN] = OP_LITERAL | count;
+
+            _RUN = _LEN;
+            _REPEAT = true;
+            put(OP_REPEAT);
+            put(3);
+            put(glyph);
+            return;
+        }
+
+        if (count < 0x7F)
+        {
+            _BUFFER[_RUN]++;
+            put(glyph);
+            return;
+        }
+    }
+
+    // Start a new literal
+    _RUN = _LEN;
+    _REPEAT = false;
+    put(OP_LITERAL | 1);
+    put(glyph);
+}
+
+void FBMirror::flush()
+{
+    if (_LEN == HEADER_BYTES)
+        return;
+
+    uint16_t payload = _LEN - HEADER_BYTES;
+    uint8_t check = 0;
+    for (int i = HEADER_BYTES; i < _LEN; i++)
+        check += _BUFFER[i];
+
+    _BUFFER[0] = 0xFB;
+    _BUFFER[1] = 0x4D;
+    _BUFFER[2] = payload & 0xFF;
+    _BUFFER[3] = payload >> 8;
+    _BUFFER[_LEN++] = check;
+
+    _OUT_CHARS((const char*)_BUFFER, _LEN);
+    _BYTES += _LEN;
+
+    _LEN = HEADER_BYTES;
+    _RUN = 0;
+}
+
+void FBMirror::request_sync()
+{
+    _LEN = HEADER_BYTES;
+    _RUN = 0;
+    _SYNC_NEEDED = true;
+}
+
+bool FBMirror::needs_sync()
+{
+    return _SYNC_NEEDED;
+}
+
+void FBMirror::begin_sync()
+{
+    _LEN = HEADER_BYTES;
+    _RUN = 0;
+    _SYNC_NEEDED = false;
+    _SYNCING = true;
+}
+
+void FBMirror::end_sync()
+{
+    _SYNCING = false;
+}
+
+void FBMirror::get_stats(uint32_t* updates, uint32_t* bytes)
+{
+    *updates = _UPDATES;
+    *bytes = _BYTES;
+}
@@ -0,0 +1,122 @@
+// Copyright 2021 Dominic Houghton. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+/* Compact stream of console changes, for mirroring the screen to a host
+
+ * FBConsole reports changes at the level of cells rather than pixels, and
+ * FBMirror encodes them into a RAM buffer. flush() sends the buffer as one
+ * frame, so bursts of output are coalesced into a single write; it should be
+ * called periodically rather than after every character.
+ * 
+ * If the buffer fills before it is flushed, the pending changes are dropped
+ * and the console resends the whole screen at the next flush instead, so the
+ * stream never costs more than a screen per flush. tools/fbmirror_view.py
+ * rebuilds the screen on the host.
+ * 
+ * Frames are: 0xFB 0x4D, payload length (16 bit, little endian), payload,
+ * then the 8 bit sum of the payload. Other bytes between frames, such as
+ * ordinary stdio text on the same channel, are ignored by the viewer.
+ * 
+ * The payload is a sequence of operations. The viewer keeps a cursor and a
+ * current attribute, so cell writes carry neither unless they change:
+ * 
+ *   0x01 w h format    Geometry in cells; resets the cursor and attribute
+ *   0x02 i c0 c1 c2 c3 Palette entry i is colour c (32 bit, little endian)
+ *   0x03 attr          Fill the screen with spaces in attr, cursor to 0,0
+ *   0x04 attr          Scroll up a row, new bottom row is spaces in attr,
+ *                      cursor moves up a row
+ *   0x05 x y           Move the cursor
+ *   0x06 attr          Set the attribute for following cells
+ *   0x07               Move the cursor to the start of the next row
+ *   0x08 n glyph       Write glyph n times
+ *   0x80 | n, glyph*n  Write n (1-127) glyphs
+ * 
+ * Writes advance the cursor, wrapping at the end of each row. Glyphs are font
+ * indices, and attributes are foreground << 4 | background palette indices,
+ * as in FBConsole's cell state. Consoles are limited to 255 x 255 cells.
+ */
+
+#ifndef FBMIRROR_H
+#define FBMIRROR_H
+
+#include <stdint.h>
+
+// Pixel format of palette colours, so the viewer can show them
+enum fbmirror_format {
+    FBMIRROR_MONO           = 0,    // 0 or 1
+    FBMIRROR_RGB565         = 1,
+    FBMIRROR_RGB565_SWAPPED = 2,    // Byte-swapped, as ILI9341 uses by default
+    FBMIRROR_XRGB8888       = 3,
+};
+
+class FBMirror {
+    public:
+        FBMirror(void (*out_chars)(const char* buf, int len), uint8_t format, uint16_t buffer_size = 1024);
+        ~FBMirror();
+        FBMirror(const FBMirror&) = delete;
+        FBMirror& operator=(const FBMirror&) = delete;
+
+        // Changes, reported by FBConsole
+        void geometry(uint8_t width, uint8_t height);
+        void palette(uint8_t index, uint32_t color);
+        void clear(uint8_t attr);
+        void scroll(uint8_t attr);
+        void cell(uint8_t x, uint8_t y, uint8_t glyph, uint8_t attr);
+
+        // Sends the pending changes as one frame
+        void flush();
+
+        // Asks for the whole screen to be resent, e.g. for a viewer that has just connected
+        void request_sync();
+        bool needs_sync();
+        // Bracket resending the screen; frames are sent as the buffer fills instead of dropped
+        void begin_sync();
+        void end_sync();
+
+        // Changes reported (excluding resent screens), and bytes sent
+        void get_stats(uint32_t* updates, uint32_t* bytes);
+
+    private:
+        bool reserve();
+        void put(uint8_t byte);
+        void append_glyph(uint8_t glyph);
+
+        void (*_OUT_CHARS)(const char* buf, int len);
+        uint8_t _FORMAT;
+        uint8_t* _BUFFER;
+        uint16_t _SIZE;
+        uint16_t _LEN;
+
+        // The viewer's state, as of the end of the buffer
+        uint8_t _WIDTH;
+        uint8_t _CURSOR_X;
+        uint8_t _CURSOR_Y;
+        uint8_t _ATTR;
+
+        // Offset of the literal or repeat operation being extended, or 0 if none
+        uint16_t _RUN;
+        bool _REPEAT;
+
+        bool _SYNC_NEEDED;
+        bool _SYNCING;
+
+        uint32_t _UPDATES;
+        uint32_t _BYTES;
+
+        static const uint8_t OP_GEOMETRY = 0x01;
+        static const uint8_t OP_PALETTE = 0x02;
+        static const uint8_t OP_CLEAR = 0x03;
+        static const uint8_t OP_SCROLL = 0x04;
+        static const uint8_t OP_GOTO = 0x05;
+        static const uint8_t OP_ATTR = 0x06;
+        static const uint8_t OP_NEWLINE = 0x07;
+        static const uint8_t OP_REPEAT = 0x08;
+        static const uint8_t OP_LITERAL = 0x80;
+
+        // Frame header, and the most one change can add (attribute, goto and a new repeat)
+        static const uint16_t HEADER_BYTES = 4;
+        static const uint16_t MAX_CHANGE_BYTES = 8;
+};
+
+#endif
@@ -0,0 +1,67 @@
+// Copyright 2021 Dominic Houghton. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Timeline tracing of display transactions
+
+#include "fbtrace.hpp"
+
+#ifdef FBTRACE_ENABLED
+
+#include "pico/stdlib.h"
+
+#include <stdio.h>
+
+fbtrace_event fbtrace_ring[FBTRACE_EVENTS];
+uint32_t fbtrace_head = 0;      // Next slot to write
+uint32_t fbtrace_count = 0;     // Events in the ring
+uint32_t fbtrace_dropped = 0;   // Events overwritten before being dumped
+
+void fbtrace_record(uint8_t type, uint8_t source, uint16_t a, uint16_t b, uint16_t c, uint32_t d)
+{
+    fbtrace_event* event = &fbtrace_ring[fbtrace_head];
+    event->timestamp = time_us_32();
+    event->type = type;
+    event->source = source;
+    event->a = a;
+    event->b = b;
+    event->c = c;
+    event->d = d;
+
+    fbtrace_head = (fbtrace_head + 1) % FBTRACE_EVENTS;
+    if (fbtrace_count < FBTRACE_EVENTS)
+        fbtrace_count++;
+    else
+        fbtrace_dropped++;
+}
+
+void fbtrace_dump(void (*out_chars)(const char* buf, int len))
+{
+    char line[64];
+    int len;
+
+    // Take a copy of the ring state, so events recorded by the output
+    // driver itself don't disturb the dump
+    uint32_t count = fbtrace_count;
+    uint32_t tail = (fbtrace_head + FBTRACE_EVENTS - count) % FBTRACE_EVENTS;
+
+    len = snprintf(line, sizeof(line), "FBTRACE BEGIN %lu %lu\n",
+                   (unsigned long)count, (unsigned long)fbtrace_dropped);
+    out_chars(line, len);
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        fbtrace_event* event = &fbtrace_ring[(tail + i) % FBTRACE_EVENTS];
+        len = snprintf(line, sizeof(line), "FBTRACE %08lx %02x %02x %04x %04x %04x %08lx\n",
+                       (unsigned long)event->timestamp, event->type, event->source,
+                       event->a, event->b, event->c, (unsigned long)event->d);
+        out_chars(line, len);
+    }
+
+    out_chars("FBTRACE END\n", 12);
+
+    fbtrace_count = 0;
+    fbtrace_dropped = 0;
+}
+
+#endif
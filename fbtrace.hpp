@@ -0,0 +1,61 @@
+// Copyright 2021 Dominic Houghton. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+/* Timeline tracing of display transactions
+
+ * When built with FBTRACE_ENABLED, the FBTRACE macro records fixed-size
+ * events with microsecond timestamps into a RAM ring buffer, overwriting the
+ * oldest once full. fbtrace_dump writes the ring out as text, which
+ * tools/fbtrace2chrome.py converts into Chrome trace JSON (chrome://tracing
+ * or Perfetto).
+ * 
+ * Without FBTRACE_ENABLED, FBTRACE expands to nothing and its arguments are
+ * not evaluated, so the instrumentation costs nothing.
+ */
+
+#ifndef FBTRACE_H
+#define FBTRACE_H
+
+#include <stdint.h>
+
+#ifndef FBTRACE_EVENTS
+#define FBTRACE_EVENTS 1024
+#endif
+
+enum fbtrace_type {
+    FBTRACE_WINDOW      = 1,    // a = x0, b = y0, c = x1, d = y1
+    FBTRACE_BURST_BEGIN = 2,    // d = bytes
+    FBTRACE_BURST_END   = 3,    // d = bytes
+    FBTRACE_SCROLL      = 4,    // a = pixels, d = new scroll offset
+    FBTRACE_GLYPH_BEGIN = 5,    // a = character, b = column, c = row, d = 1 if drawn
+    FBTRACE_GLYPH_END   = 6,    // a = character, b = column, c = row, d = 1 if drawn
+};
+
+// 16 bytes per event
+struct fbtrace_event {
+    uint32_t timestamp;     // Microseconds since boot
+    uint8_t  type;          // fbtrace_type
+    uint8_t  source;        // Display (SPI instance) or console the event came from
+    uint16_t a;
+    uint16_t b;
+    uint16_t c;
+    uint32_t d;
+};
+
+#ifdef FBTRACE_ENABLED
+
+void fbtrace_record(uint8_t type, uint8_t source, uint16_t a, uint16_t b, uint16_t c, uint32_t d);
+
+// Writes every event in the ring, oldest first, then empties it
+void fbtrace_dump(void (*out_chars)(const char* buf, int len));
+
+#define FBTRACE(type, source, a, b, c, d) fbtrace_record((type), (source), (a), (b), (c), (d))
+
+#else
+
+#define FBTRACE(type, source, a, b, c, d) ((void)0)
+
+#endif
+
+#endif
@@ -5,15 +5,54 @@
 // ILI9341 SPI display driver for Raspberry Pico, confirming to I_Framebuffer interface
 
 #include "ili9341.hpp"
+#include "ili9341_rows.hpp"
+#include "rgb565.hpp"
+#include "fbtrace.hpp"
+#include "fbcalibrate.hpp"
 
 #include "pico/stdlib.h"
 #include "hardware/spi.h"
+#include "hardware/dma.h"
 
 #include <stdint.h>
 #include <string.h>
 #include <array>
 
-ILI9341::ILI9341(spi_inst_t* spiport, uint8_t miso, uint8_t mosi, uint8_t sck, uint8_t cs, uint8_t dc, uint8_t rst, uint16_t width, uint16_t height, uint16_t rotation, uint32_t baudrate) {
+#include "FBConsole_impl.hpp"
+#include "FBTerminals_impl.hpp"
+
+ILI9341* ILI9341::_BUS_OWNER[2] = {0, 0};
+ILI9341* ILI9341::_BUS_CLOCK[2] = {0, 0};
+
+// Initialisation sequence, sent after a software reset.
+// Each entry is the command, the number of parameters, then the parameters.
+static const uint8_t INIT_SEQUENCE[] = {
+    0xCF, 3,  0x00, 0xC1, 0x30,                 // Pwr ctrl B
+    0xED, 4,  0x64, 0x03, 0x12, 0x81,           // Pwr on seq. ctrl
+    0xE8, 3,  0x85, 0x00, 0x78,                 // Driver timing ctrl A
+    0xCB, 5,  0x39, 0x2C, 0x00, 0x34, 0x02,     // Pwr ctrl A
+    0xF7, 1,  0x20,                             // Pump ratio control
+    0xEA, 2,  0x00, 0x00,                       // Driver timing ctrl B
+    0xC0, 1,  0x23,                             // Pwr ctrl 1
+    0xC1, 1,  0x10,                             // Pwr ctrl 2
+    0xC5, 2,  0x3E, 0x28,                       // VCOM ctrl 1
+    0xC7, 1,  0x86,                             // VCOM ctrl 2
+    0x37, 2,  0x00, 0x00,                       // Vertical scrolling start address
+    0xB1, 2,  0x00, 0x18,                       // Frame rate ctrl
+    0xB6, 3,  0x08, 0x82, 0x27,                 // Display function ctrl
+    0xF2, 1,  0x00,                             // Enable 3 gamma ctrl
+    0x26, 1,  0x01,                             // Gamma curve selected
+    0xE0, 15, 0x0F, 0x31, 0x2B, 0x0C, 0x0E, 0x08, 0x4E, // Positive gamma correction
+              0xF1, 0x37, 0x07, 0x10, 0x03, 0x0E, 0x09, 0x00,
+    0xE1, 15, 0x00, 0x0E, 0x14, 0x03, 0x11, 0x07, 0x31, // Negative gamma correction
+              0xC1, 0x48, 0x08, 0x0F, 0x0C, 0x31, 0x36, 0x0F,
+};
+
+ILI9341::ILI9341(spi_inst_t* spiport, uint8_t miso, uint8_t mosi, uint8_t sck, uint8_t cs, uint8_t dc, uint8_t rst, uint16_t width, uint16_t height, uint16_t rotation, uint32_t baudrate, bool clear) {
+    // Time-to-first-pixel is measured from here
+    _BOOT_US = time_us_64();
+    _FIRST_PIXEL_US = 0;
+
     // Store variables passed to constructor
     _SPI = spiport;
     _MISO = miso;
@@ -25,6 +64,20 @@ ILI9341::ILI9341(spi_inst_t* spiport, uint8_t miso, uint8_t mosi, uint8_t sck, u
     _WIDTH = width;
     _HEIGHT = height;
     _SCROLL_OFFSET = 0;
+    _DMA_BUSY = false;
+    _NATIVE = false;
+    _FORMAT = WIRE_RGB565;
+    _PIXEL_BYTES = 0;
+    _POWER = POWER_NORMAL;
+    _PARTIAL_MS = 0;
+    _IDLE_MS = 0;
+    _SLEEP_MS = 0;
+    _LAST_ACTIVITY_US = _BOOT_US;
+    _WAKE_LATENCY_US = 0;
+    _SLEEP_US = 0;
+    _TEXT_TOP = 0;
+    _TEXT_BOTTOM = height - 1;
+    _CLEAR_ON_INIT = clear;
 
     // Handle rotation
     switch (rotation) {
@@ -44,8 +97,9 @@ ILI9341::ILI9341(spi_inst_t* spiport, uint8_t miso, uint8_t mosi, uint8_t sck, u
             _ROTATION = DISPLAY_ROTATE_0;
     }
 
-    // Initialise SPI (at 1MHz for now)
-    spi_init(_SPI, baudrate);
+    // Initialise SPI, keeping the actual rate for after register reads
+    _BAUDRATE = spi_init(_SPI, baudrate);
+    _BUS_CLOCK[spi_get_index(_SPI)] = this;
     gpio_set_function(_MISO, GPIO_FUNC_SPI);
     gpio_set_function(_SCK,  GPIO_FUNC_SPI);
     gpio_set_function(_MOSI, GPIO_FUNC_SPI);
@@ -63,136 +117,132 @@ ILI9341::ILI9341(spi_inst_t* spiport, uint8_t miso, uint8_t mosi, uint8_t sck, u
     gpio_set_dir(_DC, GPIO_OUT);
     gpio_put(_DC, 0);
 
+    // Claim a DMA channel for pixel transfers. If none are left, plot_block_async
+    // falls back to blocking writes.
+    _BUS = ILI9341_SPI(_SPI, _CS, _DC, dma_claim_unused_channel(false));
+
     // Reset display
     reset();
 }
 
 void ILI9341::reset()
 {
-    // Reset pin is active low; pulse it low for 50ms
+    // Reset pin is active low; the datasheet requires a pulse of at least 10us
     gpio_put(_RST, 0);
-    sleep_ms(50);
+    sleep_us(20);
     gpio_put(_RST, 1);
-    sleep_ms(50);
+
+    // Commands are ignored for the first 5ms while the defaults load, then
+    // poll until the controller reports its reset state
+    sleep_ms(RESET_MIN_MS);
+    wait_status(0xFF, RDMODE_NORMAL, RESET_TIMEOUT_MS - RESET_MIN_MS);
 
     // Re-initialise the display
     initialise();
 }
 
-void ILI9341::write_data(uint8_t* args, uint32_t len)
+void ILI9341::write_data(uint8_t data)
 {
     // We're writing data, so drive the DC pin high
     gpio_put(_DC, 1);
 
     // CS pin is active low, drive it low while writing
     gpio_put(_CS, 0);
-    spi_write_blocking(_SPI, args, len);
+    spi_write_blocking(_SPI, &data, 1);
     gpio_put(_CS, 1);
 }
 
-void ILI9341::write_data(uint8_t data)
+void ILI9341::write_cmd(uint8_t command, uint8_t* data, uint32_t len)
 {
-    // We're writing data, so drive the DC pin high
-    gpio_put(_DC, 1);
-
-    // CS pin is active low, drive it low while writing
-    gpio_put(_CS, 0);
-    spi_write_blocking(_SPI, &data, 1);
-    gpio_put(_CS, 1);
+    write_cmd(command);
+    write_data(data, len);
 }
 
-void ILI9341::write_cmd(uint8_t command)
+uint8_t ILI9341::read_register(uint8_t command)
 {
-    // We're writing a command, so drive the DC pin low
-    gpio_put(_DC, 0);
+    uint8_t value;
 
-    // CS pin is active low, drive it low while writing
+    wait_bus();
+    spi_set_baudrate(_SPI, READ_BAUDRATE);
+
+    // Hold CS low across the command and the reply
+    gpio_put(_DC, 0);
     gpio_put(_CS, 0);
     spi_write_blocking(_SPI, &command, 1);
+    gpio_put(_DC, 1);
+    spi_read_blocking(_SPI, 0x00, &value, 1);
     gpio_put(_CS, 1);
-}
 
-void ILI9341::write_cmd(uint8_t command, uint8_t* data, uint32_t len)
-{
-    write_cmd(command);
-    write_data(data, len);
+    spi_set_baudrate(_SPI, _BAUDRATE);
+    return value;
 }
 
-bool ILI9341::bounds(uint16_t x, uint16_t y)
+bool ILI9341::wait_status(uint8_t mask, uint8_t value, uint32_t timeout_ms)
 {
-    if (x < 0)
-        return false;
-    if (y < 0)
-        return false;
-    if (x > _WIDTH)
-        return false;
-    if (y > _HEIGHT)
-        return false;
-    
-    return true;
+    // Poll RDMODE until the masked bits match, or the timeout passes. The two
+    // lowest bits of RDMODE are reserved and read as 0, so 0xFF is a MISO
+    // floating high or not connected rather than a status, and would match
+    // most masks. That is treated as no status, taking the full timeout,
+    // which is the datasheet's worst case.
+    uint64_t deadline = time_us_64() + (timeout_ms * 1000);
+    while (time_us_64() < deadline)
+    {
+        uint8_t mode = read_register(RDMODE);
+        if ((mode != 0xFF) && ((mode & mask) == value))
+            return true;
+        sleep_us(500);
+    }
+    return false;
 }
 
-void ILI9341::plot_block(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t* pixeldata, uint32_t len)
+void ILI9341::plot_wrapped(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t* pixeldata, uint32_t len, bool async)
 {
-    uint8_t locdat[4];
+    // y0 and y1 already have the offset applied, and only y1 is beyond _HEIGHT
 
-    // Bounds check
-    if (!bounds(x0, y0))
-        return;
-    if (!bounds(x1, y1))
-        return;
-
-    // Add offset
-    y0 += _SCROLL_OFFSET;
-    y1 += _SCROLL_OFFSET;
+    // Calculate the width of the block
+    int width = MAX(x0 - x1, x1 - x0) + 1;
 
-    // Check if either y0 or y1 is set beyond _HEIGHT, after applying _SCROLL_OFFSET
-    if ((y0 >= _HEIGHT) || (y1 >= _HEIGHT))
-    {
-        // If either y0 or y1 is beyond the framebuffer memory, but the other is not, place two draw calls.
-        if (!((y0 >= _HEIGHT) && (y1 >= _HEIGHT)))
-        {
-            // Calculate the width of the block
-            int width = MAX(x0 - x1, x1 - x0) + 1;
+    // Calculate the length of the top section of the block
+    int first_length = width * (_HEIGHT - y0);
 
-            // Calculate the length of the top section of the block
-            int first_length = width * (_HEIGHT - y0);
+    // Calculate the length of the bottom section of the block
+    int second_length = len - first_length;
 
-            // Calculate the length of the bottom section of the block
-            int second_length = len - first_length;
+    // Plot both sections of the block
+    plot(x0, y0-_SCROLL_OFFSET, x1, _HEIGHT-1-_SCROLL_OFFSET, pixeldata, first_length, async);
+    plot(x0, _HEIGHT-_SCROLL_OFFSET, x1, y1-_SCROLL_OFFSET, &(pixeldata[first_length]), second_length, async);
+}
 
-            // Plot both sections of the block
-            plot_block(x0, y0-_SCROLL_OFFSET, x1, _HEIGHT-1-_SCROLL_OFFSET, pixeldata, first_length);
-            plot_block(x0, _HEIGHT-_SCROLL_OFFSET, x1, y1-_SCROLL_OFFSET, &(pixeldata[first_length]), second_length);
-            
-            // Return so we don't try to draw again
-            return;
-        }
+void ILI9341::wait_idle()
+{
+    if (!_DMA_BUSY)
+        return;
 
-        // Both y0 and y1 are beyond _HEIGHT, after applying _SCROLL_OFFSET, so just account for that and wrap.
-        y0 %= _HEIGHT;
-        y1 %= _HEIGHT;
-    }
+    _BUS.finish_async();
+    _DMA_BUSY = false;
+    FBTRACE(FBTRACE_BURST_END, spi_get_index(_SPI), 0, 0, 0, 0);
+    _BUS_OWNER[spi_get_index(_SPI)] = 0;
+}
 
-    // Prepare the data for SET_COLUMN, expects big endian
-    locdat[0] = (x0 >> 8);
-    locdat[1] = (x0 & 0xFF);
-    locdat[2] = (x1 >> 8);
-    locdat[3] = (x1 & 0xFF);
-    write_cmd(SET_COLUMN);
-    write_data(locdat, 4);
+void ILI9341::mark_first_pixel()
+{
+    if (_FIRST_PIXEL_US == 0)
+        _FIRST_PIXEL_US = (uint32_t)(time_us_64() - _BOOT_US);
+}
 
-    // Prepare the data for SET_PAGE, expects big endian
-    locdat[0] = (y0 >> 8);
-    locdat[1] = (y0 & 0xFF);
-    locdat[2] = (y1 >> 8);
-    locdat[3] = (y1 & 0xFF);
-    write_cmd(SET_PAGE);
-    write_data(locdat, 4);
+void ILI9341::write_pixels(uint16_t* pixeldata, uint32_t len, bool async)
+{
+    FBTRACE(FBTRACE_BURST_BEGIN, spi_get_index(_SPI), 0, 0, 0, wire_bytes(len));
+    _PIXEL_BYTES += wire_bytes(len);
 
-    // Write the desired pixel data
-    write_cmd(WRITE_RAM);
-    write_data((uint8_t*)pixeldata, len*2);
+    if (ili9341_write_pixels(&_BUS, pixeldata, len, _NATIVE, _FORMAT == WIRE_RGB666, async))
+    {
+        // The DMA is left running with CS held low; wait_idle releases it
+        _DMA_BUSY = true;
+        _BUS_OWNER[spi_get_index(_SPI)] = this;
+        return;
+    }
+    FBTRACE(FBTRACE_BURST_END, spi_get_index(_SPI), 0, 0, 0, wire_bytes(len));
 }
 
 void ILI9341::plot_pixel(uint16_t x, uint16_t y, uint16_t color)
@@ -202,118 +252,329 @@ void ILI9341::plot_pixel(uint16_t x, uint16_t y, uint16_t color)
 
 void ILI9341::clear(uint16_t color)
 {
-    uint16_t data[_WIDTH * 16];
-    std::fill(data, &data[_WIDTH * 16], color);
-    
-
-    for (int y = 0; y < _HEIGHT; y+= 8)
+    // Stream a small buffer repeatedly into a single full-screen window,
+    // rather than building a large block on the stack
+    uint16_t data[ILI9341_PACK_PIXELS];
+    uint8_t wire[ILI9341_PACK_PIXELS * 3];
+    std::fill(data, &data[ILI9341_PACK_PIXELS], color);
+
+    // Every pixel is the same, so packed formats only need packing once
+    bool packed = (_FORMAT != WIRE_RGB565);
+    if (packed)
+        rgb565_pack_rgb666(data, ILI9341_PACK_PIXELS, wire, !_NATIVE);
+
+    // The whole of display RAM is cleared, so the scroll offset doesn't matter
+    wake();
+    set_window(0, 0, _WIDTH - 1, _HEIGHT - 1);
+
+    uint32_t remaining = (uint32_t)_WIDTH * _HEIGHT;
+    uint32_t total = wire_bytes(remaining);
+    FBTRACE(FBTRACE_BURST_BEGIN, spi_get_index(_SPI), 0, 0, 0, total);
+    _BUS.begin_data(_NATIVE && !packed);
+    while (remaining > 0)
     {
-        plot_block(0, y, _WIDTH - 1, y + 7, data, _WIDTH * 16);
+        uint32_t len = MIN(remaining, ILI9341_PACK_PIXELS);
+        if (packed)
+            _BUS.write8(wire, wire_bytes(len));
+        else if (_NATIVE)
+            _BUS.write16(data, len);
+        else
+            _BUS.write8((uint8_t*)data, len * 2);
+        remaining -= len;
     }
+    _BUS.end_data();
+    FBTRACE(FBTRACE_BURST_END, spi_get_index(_SPI), 0, 0, 0, total);
+    _PIXEL_BYTES += total;
+
+    mark_first_pixel();
 }
 
 void ILI9341::initialise()
 {
-    // Software reset
-    write_cmd(SWRESET);  
-    sleep_ms(100);
-
-    // Pwr ctrl B
-    write_cmd(PWCTRB);
-    write_data((uint8_t*)PWCTRB_D, 3);
+    // Software reset. The controller is in sleep in mode after the hardware
+    // reset, so this only needs the short fixed wait for the defaults to load;
+    // RDMODE can't tell us when that has finished.
+    write_cmd(SWRESET);
+    sleep_ms(RESET_MIN_MS);
+
+    // Send the initialisation sequence
+    uint32_t i = 0;
+    while (i < sizeof(INIT_SEQUENCE))
+    {
+        uint8_t command = INIT_SEQUENCE[i];
+        uint8_t len = INIT_SEQUENCE[i + 1];
+        write_cmd(command, (uint8_t*)&INIT_SEQUENCE[i + 2], len);
+        i += 2 + len;
+    }
 
-    // Pwr on seq. ctrl
-    write_cmd(POSC);
-    write_data((uint8_t*)POSC_D, 4);
+    // Memory access ctrl
+    write_cmd(MADCTL);
+    write_data(_ROTATION);
 
-    // Driver timing ctrl A
-    write_cmd(DTCA);
-    write_data((uint8_t*)DTCA_D, 3);
+    // COLMOD: Pixel format
+    set_wire_format(_FORMAT);
 
-    // Pwr ctrl A
-    write_cmd(PWCTRA);
-    write_data((uint8_t*)PWCTRA_D, 5);
+    // Exit sleep, and wait for the booster to come up
+    write_cmd(SLPOUT);
+    sleep_ms(RESET_MIN_MS);
+    wait_status(RDMODE_BOOSTER | RDMODE_SLEEP_OUT, RDMODE_BOOSTER | RDMODE_SLEEP_OUT, SLPOUT_TIMEOUT_MS - RESET_MIN_MS);
 
+    // Turn on display
+    write_cmd(DISPLAY_ON);
 
-    // Pump ratio control
-    write_cmd(PUMPRC);
-    write_data(0x20);
+    // Clear display
+    if (_CLEAR_ON_INIT)
+        clear();
+}
 
+void ILI9341::set_wire_format(WireFormat format)
+{
+    uint8_t pixfmt;
+    switch (format)
+    {
+        case WIRE_RGB666:
+            pixfmt = PIXFMT_18BPP;
+            break;
+        default:
+            pixfmt = PIXFMT_16BPP;
+            break;
+    }
 
-    // Driver timing ctrl B
-    write_cmd(DTCB);
-    write_data((uint8_t*)DTCB_D, 2);
+    write_cmd(PIXFMT);
+    write_data(pixfmt);
+    _FORMAT = format;
+}
 
+uint32_t ILI9341::get_pixel_bytes()
+{
+    return _PIXEL_BYTES;
+}
 
-    // Pwr ctrl 1
-    write_cmd(PWCTR1);
-    write_data(0x23);
+uint32_t ILI9341::wire_bytes(uint32_t len)
+{
+    switch (_FORMAT)
+    {
+        case WIRE_RGB666:
+            return len * 3;
+        default:
+            return len * 2;
+    }
+}
 
+// The calibration search's view of the display: the SPI clock, and a write of
+// the test patterns with READ_RAM readback
+class ILI9341_Calibration : public FBCalibrate_Bus {
+    public:
+        ILI9341_Calibration(ILI9341* display) { _DISPLAY = display; }
 
-    // Pwr ctrl 2
-    write_cmd(PWCTR2);
-    write_data(0x10);
+        uint32_t set_baudrate(uint32_t baudrate)
+        {
+            _DISPLAY->set_baudrate(baudrate);
+            return _DISPLAY->_BAUDRATE;
+        }
 
+        bool write_readback()
+        {
+            return _DISPLAY->verify_patterns();
+        }
 
-    // VCOM ctrl 1
-    write_cmd(VMCTR1);
-    write_data((uint8_t*)VMCTR1_D, 2);
+    private:
+        ILI9341* _DISPLAY;
+};
 
+uint32_t ILI9341::calibrate(uint32_t min_baudrate, uint32_t max_baudrate, uint32_t step, uint8_t margin_percent)
+{
+    ILI9341_Calibration bus(this);
+    uint32_t original = _BAUDRATE;
 
-    // VCOM ctrl 2
-    write_cmd(VMCTR2);
-    write_data(0x86);
+    // Hide the test patterns, which are written as RGB565
+    WireFormat format = _FORMAT;
+    write_cmd(DISPLAY_OFF);
+    set_wire_format(WIRE_RGB565);
 
+    uint32_t baudrate = fbcalibrate(&bus, min_baudrate, max_baudrate, step, margin_percent);
+    if (baudrate == 0)
+        set_baudrate(original);
 
-    // Memory access ctrl
-    write_cmd(MADCTL);
-    write_data(_ROTATION);
+    set_wire_format(format);
+    write_cmd(DISPLAY_ON);
+    clear();
 
+    return baudrate;
+}
 
-    // Vertical scrolling start address
-    write_cmd(VSCRSADD);
-    write_data(0x00);
+// Writes and reads back each calibration pattern at the current clock
+bool ILI9341::verify_patterns()
+{
+    uint16_t pattern[CALIBRATION_PIXELS];
+    uint32_t seed = 0x1234567;
 
+    for (int pass = 0; pass < CALIBRATION_PASSES; pass++)
+    {
+        // Alternate bits, walking bits, and pseudo-random data
+        for (uint32_t i = 0; i < CALIBRATION_PIXELS; i++)
+        {
+            switch (pass)
+            {
+                case 0:
+                    pattern[i] = (i & 1) ? 0xAAAA : 0x5555;
+                    break;
+                case 1:
+                    pattern[i] = 1 << (i % 16);
+                    break;
+                default:
+                    seed = (seed * 1103515245) + 12345;
+                    pattern[i] = seed >> 16;
+                    break;
+            }
+        }
 
-    // COLMOD: Pixel format
-    write_cmd(PIXFMT);
-    write_data(0x55);
+        if (!verify_pattern(pattern, CALIBRATION_PIXELS))
+            return false;
+    }
+    return true;
+}
 
+bool ILI9341::verify_pattern(uint16_t* pattern, uint32_t len)
+{
+    uint8_t readback[3];
+    uint16_t wire[CALIBRATION_PIXELS];
+
+    // Write the pattern at the calibration clock, in whichever byte order the
+    // current mode sends
+    for (uint32_t i = 0; i < len; i++)
+        wire[i] = _NATIVE ? pattern[i] : rgb565_swap(pattern[i]);
+    set_window(0, 0, _WIDTH - 1, _HEIGHT - 1);
+    write_pixels(wire, len, false);
+
+    // Read it back at a safe clock. The window is restarted by READ_RAM.
+    spi_set_baudrate(_SPI, READ_BAUDRATE);
+    uint8_t command = READ_RAM;
+    gpio_put(_DC, 0);
+    gpio_put(_CS, 0);
+    spi_write_blocking(_SPI, &command, 1);
+    gpio_put(_DC, 1);
 
-    // Frame rate ctrl
-    write_cmd(FRMCTR1);
-    write_data((uint8_t*)FRMCTR1_D, 2);
+    // The first byte is a dummy, then each pixel reads as 6 bits per channel
+    // in the top of three bytes
+    bool ok = true;
+    spi_read_blocking(_SPI, 0x00, readback, 1);
+    for (uint32_t i = 0; i < len; i++)
+    {
+        spi_read_blocking(_SPI, 0x00, readback, 3);
+        uint16_t color = ((readback[0] & 0xF8) << 8) | ((readback[1] & 0xFC) << 3) | (readback[2] >> 3);
+        if (color != pattern[i])
+        {
+            ok = false;
+            break;
+        }
+    }
+    gpio_put(_CS, 1);
 
+    spi_set_baudrate(_SPI, _BAUDRATE);
+    return ok;
+}
 
-    write_cmd(DFUNCTR);
-    write_data((uint8_t*)DFUNCTR_D, 3);
+void ILI9341::set_baudrate(uint32_t baudrate)
+{
+    wait_bus();
+    _BAUDRATE = spi_set_baudrate(_SPI, baudrate);
+}
 
+uint32_t ILI9341::get_baudrate()
+{
+    return _BAUDRATE;
+}
 
-    // Enable 3 gamma ctrl
-    write_cmd(ENABLE3G);
-    write_data(0x00);
+void ILI9341::set_power_timeouts(uint32_t partial_ms, uint32_t idle_ms, uint32_t sleep_ms)
+{
+    _PARTIAL_MS = partial_ms;
+    _IDLE_MS = idle_ms;
+    _SLEEP_MS = sleep_ms;
+}
 
-    // Gamma curve selected
-    write_cmd(GAMMASET);
-    write_data(0x01);
+uint32_t ILI9341::get_wake_latency_us()
+{
+    return _WAKE_LATENCY_US;
+}
 
+void ILI9341::set_text_rows(int32_t top, int32_t bottom)
+{
+    _TEXT_TOP = top;
+    _TEXT_BOTTOM = bottom;
+}
 
-    write_cmd(GMCTRP1);
-    write_data((uint8_t*)GMCTRP1_D, 15);
 
+void ILI9341::power_tick()
+{
+    uint32_t quiet_ms = (uint32_t)((time_us_64() - _LAST_ACTIVITY_US) / 1000);
+    uint8_t locdat[4];
 
-    write_cmd(GMCTRN1);
-    write_data((uint8_t*)GMCTRN1_D, 15);
+    if (_SLEEP_MS && (quiet_ms >= _SLEEP_MS))
+    {
+        if (_POWER != POWER_SLEEP)
+        {
+            write_cmd(SLPIN);
+            _SLEEP_US = time_us_64();
+            _POWER = POWER_SLEEP;
+        }
+    }
+    else if (_IDLE_MS && (quiet_ms >= _IDLE_MS))
+    {
+        if (_POWER < POWER_IDLE)
+        {
+            write_cmd(IDMON);
+            _POWER = POWER_IDLE;
+        }
+    }
+    else if (_PARTIAL_MS && (quiet_ms >= _PARTIAL_MS))
+    {
+        // Partial mode is set in display RAM rows, so it isn't used when rows
+        // and columns are exchanged, or when every row has text on
+        if ((_POWER < POWER_PARTIAL) && !(_ROTATION & MADCTL_MV) &&
+            !((_TEXT_TOP <= 0) && (_TEXT_BOTTOM >= (_HEIGHT - 1))))
+        {
+            // Convert the text rows to display RAM rows, as scrolled and
+            // with MY reversing the row order (see ili9341_rows.hpp)
+            uint16_t start, end;
+            ili9341_partial_area(MAX(_TEXT_TOP, 0), MAX(_TEXT_BOTTOM, 0), _HEIGHT, _SCROLL_OFFSET,
+                                 (_ROTATION & MADCTL_MY) != 0, &start, &end);
+            locdat[0] = (start >> 8);
+            locdat[1] = (start & 0xFF);
+            locdat[2] = (end >> 8);
+            locdat[3] = (end & 0xFF);
+            write_cmd(PTLAR, locdat, 4);
+            write_cmd(PTLON);
+            _POWER = POWER_PARTIAL;
+        }
+    }
+}
 
-    // Exit sleep
-    write_cmd(SLPOUT);
-    sleep_ms(100);
+void ILI9341::wake()
+{
+    _LAST_ACTIVITY_US = time_us_64();
+    if (_POWER == POWER_NORMAL)
+        return;
 
-    // Turn on display
-    write_cmd(DISPLAY_ON);
+    // Display RAM is kept while asleep, so only the modes need restoring
+    if (_POWER == POWER_SLEEP)
+    {
+        // SLPOUT may not follow SLPIN too closely
+        uint64_t earliest = _SLEEP_US + (SLPIN_MIN_MS * 1000);
+        if (time_us_64() < earliest)
+            sleep_us(earliest - time_us_64());
 
-    // Clear display
-    clear();
+        write_cmd(SLPOUT);
+        sleep_ms(RESET_MIN_MS);
+    }
+    if (_POWER >= POWER_IDLE)
+        write_cmd(IDMOFF);
+    write_cmd(NORON);
+    _POWER = POWER_NORMAL;
+
+    uint32_t latency = (uint32_t)(time_us_64() - _LAST_ACTIVITY_US);
+    if (latency > _WAKE_LATENCY_US)
+        _WAKE_LATENCY_US = latency;
 }
 
 void ILI9341::scroll(uint16_t pixels)
@@ -325,12 +586,26 @@ void ILI9341::scroll(uint16_t pixels)
 
 uint16_t ILI9341::get_color(uint8_t r, uint8_t g, uint8_t b)
 {
-    uint16_t color = ((r & 0xf8) << 8 | (g & 0xfc) << 3 | b >> 3);
+    uint16_t color = rgb565(r, g, b);
+    if (_NATIVE)
+        return color;
+
     uint8_t color_big[2] = {(uint8_t)(color >> 8), (uint8_t)(color & 0xFF)};
     uint16_t* retval = (uint16_t*)(color_big);
     return *retval;
 }
 
+void ILI9341::set_native_endian(bool native)
+{
+    wait_idle();
+    _NATIVE = native;
+}
+
+uint32_t ILI9341::get_first_pixel_us()
+{
+    return _FIRST_PIXEL_US;
+}
+
 void ILI9341::get_dimensions(uint16_t* width, uint16_t* height)
 {
     *width = _WIDTH;
@@ -339,10 +614,19 @@ void ILI9341::get_dimensions(uint16_t* width, uint16_t* height)
 
 void ILI9341::scroll_vertical(uint16_t pixels)
 {
+    wake();
+
     _SCROLL_OFFSET += pixels;
     if (_SCROLL_OFFSET >= _HEIGHT)
         _SCROLL_OFFSET %= _HEIGHT;
+    FBTRACE(FBTRACE_SCROLL, spi_get_index(_SPI), pixels, 0, 0, _SCROLL_OFFSET);
+
+    // Set the offset. The panel starts scanning at the scroll start address,
+    // which is in its own row order: with MY set, the row it shows first
+    // counts back from the end of RAM.
+    scroll((_HEIGHT - _SCROLL_OFFSET) % _HEIGHT);
+}
 
-    // Set the offset
-    scroll(_HEIGHT - _SCROLL_OFFSET);
-}
\ No newline at end of file
+// Statically dispatched consoles, compiled here so the driver can be inlined into them
+template class FBConsole<uint16_t, ILI9341>;
+template class FBTerminals<uint16_t, ILI9341>;
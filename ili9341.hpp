@@ -7,39 +7,130 @@
 #ifndef ILI9341_H
 #define ILI9341_H
 
+#include "pico/stdlib.h"
 #include "hardware/spi.h"
+#include "hardware/dma.h"
 #include "I_Framebuffer.hpp"
+#include "ili9341_bus.hpp"
+#include "fbtrace.hpp"
 
-class ILI9341 : public I_Framebuffer<uint16_t> {
+// The pixel data path over an SPI instance, with DMA for background transfers.
+// Marked final so that ili9341_write_pixels calls it without virtual dispatch.
+class ILI9341_SPI final : public ILI9341_Bus {
+    public:
+        ILI9341_SPI() : _SPI(0), _CS(0), _DC(0), _DMA(-1), _FRAMES16(false) {}
+        ILI9341_SPI(spi_inst_t* spi, uint8_t cs, uint8_t dc, int dma) : _SPI(spi), _CS(cs), _DC(dc), _DMA(dma), _FRAMES16(false) {}
+
+        void begin_data(bool frames16);
+        void write8(const uint8_t* data, uint32_t len);
+        void write16(const uint16_t* data, uint32_t len);
+        void end_data();
+        bool start_async(const void* data, uint32_t count, bool frames16);
+
+        // Waits for a transfer from start_async to leave the SPI, then ends the transaction
+        void finish_async();
+
+    private:
+        spi_inst_t* _SPI;
+        uint8_t     _CS;
+        uint8_t     _DC;
+        int         _DMA;       // DMA channel, or -1 if none could be claimed
+        bool        _FRAMES16;
+};
+
+// Marked final so that FBConsole<uint16_t, ILI9341> can call it without virtual dispatch
+class ILI9341 final : public I_Framebuffer<uint16_t> {
     public:
         // By default, we drive the SPI interface at 25MHz, I've had success with this.
-        ILI9341(spi_inst* spiport, uint8_t miso, uint8_t mosi, uint8_t sck, uint8_t cs, uint8_t ds, uint8_t rst, uint16_t width=240, uint16_t height=320, uint16_t rotation=0, uint32_t baudrate=25*1000*1000);
+        // Pass clear=false to skip clearing the display on reset, if something is about to paint the whole screen anyway.
+        ILI9341(spi_inst* spiport, uint8_t miso, uint8_t mosi, uint8_t sck, uint8_t cs, uint8_t ds, uint8_t rst, uint16_t width=240, uint16_t height=320, uint16_t rotation=0, uint32_t baudrate=25*1000*1000, bool clear=true);
         void set_parameters(uint16_t width, uint16_t height, uint16_t rotation);
         void reset();
 
         // len is expected in pixels, not bytes
         void plot_block(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t* pixeldata, uint32_t len);
 
+        // As plot_block, but the pixel data is sent by DMA and may still be in flight on return.
+        // pixeldata must not be modified until wait_idle() has been called.
+        void plot_block_async(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t* pixeldata, uint32_t len);
+        void wait_idle();
+
         void plot_pixel(uint16_t x, uint16_t y, uint16_t color);
         void clear(uint16_t color = 0);
 
         // Please note - this function returns the RGB565 value in BIG ENDIAN, which is what the display expects, to allow arrays of uint16_t[] to be created without conversion.
+        // In native endian mode, it returns a native RGB565 value instead, suitable for the helpers in rgb565.hpp.
         uint16_t get_color(uint8_t r, uint8_t g, uint8_t b);
 
+        // Native endian mode sends pixels as 16-bit SPI frames, so pixel data is native RGB565 rather than byte-swapped.
+        // Colours previously returned by get_color are invalidated, so set this before attaching an FBConsole.
+        void set_native_endian(bool native);
+
+        // Interface pixel formats. Pixel data is always passed in as RGB565, and packed into the wire format in strips.
+        // RGB666 costs half as many bytes again as RGB565, for no gain in colour from RGB565 sources; it is for panels
+        // whose interface mode only accepts 18-bit colour. Packed formats are always sent blocking, without DMA.
+        // (COLMOD's 12-bit setting is reserved on the ILI9341's serial interface, so there is no RGB444 format.)
+        enum WireFormat {
+            WIRE_RGB565,    // 2 bytes per pixel
+            WIRE_RGB666,    // 3 bytes per pixel
+        };
+        void set_wire_format(WireFormat format);
+
+        // Total bytes of pixel data sent over SPI, in the wire format
+        uint32_t get_pixel_bytes();
+
         // Writes the display width & height to the variables specified
         void get_dimensions(uint16_t* width, uint16_t* height);
 
         void scroll(uint16_t pixels);
         void scroll_vertical(uint16_t pixels);
+
+        // Microseconds from the start of the constructor to the first pixel data being sent, or 0 if none has been yet
+        uint32_t get_first_pixel_us();
+
+        // Finds the fastest SPI clock that writes pixels reliably, by writing test patterns with the display off and reading
+        // them back with READ_RAM at a safe clock (see fbcalibrate.hpp for the search). The fastest clean clock, less
+        // margin_percent, is applied and returned.
+        // If even min_baudrate fails (e.g. MISO isn't connected), the current clock is kept and 0 is returned.
+        // The display is cleared afterwards.
+        uint32_t calibrate(uint32_t min_baudrate, uint32_t max_baudrate, uint32_t step, uint8_t margin_percent = 10);
+        void set_baudrate(uint32_t baudrate);
+        uint32_t get_baudrate();
+
+        // Power management, driven by power_tick(), which should be called regularly. After partial_ms without drawing,
+        // only the rows given to set_text_rows are scanned (partial mode; the rest shows black). After idle_ms,
+        // the display drops to idle (8 colour) mode, and after sleep_ms it sleeps. A timeout of 0 disables that stage.
+        // The next drawing call wakes the display before drawing.
+        void set_power_timeouts(uint32_t partial_ms, uint32_t idle_ms, uint32_t sleep_ms);
+        void power_tick();
+        void set_text_rows(int32_t top, int32_t bottom);
+
+        // Worst time taken to wake the display before a drawing call, in microseconds
+        uint32_t get_wake_latency_us();
     
     private:
+        // Reaches the SPI clock and verify_patterns for fbcalibrate
+        friend class ILI9341_Calibration;
+
         // Private methods
         void initialise();
         void write_cmd(uint8_t command);
         void write_cmd(uint8_t command, uint8_t* data, uint32_t len);
         void write_data(uint8_t* data, uint32_t len);
         void write_data(uint8_t data);
+        void wait_bus();
+        uint8_t read_register(uint8_t command);
+        bool wait_status(uint8_t mask, uint8_t value, uint32_t timeout_ms);
+        void set_window(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1);
+        void mark_first_pixel();
+        bool verify_patterns();
+        bool verify_pattern(uint16_t* pattern, uint32_t len);
+        uint32_t wire_bytes(uint32_t len);
+        void wake();
         bool bounds(uint16_t x, uint16_t y);
+        void plot(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t* pixeldata, uint32_t len, bool async);
+        void plot_wrapped(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t* pixeldata, uint32_t len, bool async);
+        void write_pixels(uint16_t* pixeldata, uint32_t len, bool async);
 
         // Private variables
         spi_inst_t* _SPI;
@@ -53,6 +144,41 @@ class ILI9341 : public I_Framebuffer<uint16_t> {
         uint16_t    _HEIGHT;
         uint8_t     _ROTATION;
         int16_t    _SCROLL_OFFSET;
+        ILI9341_SPI _BUS;
+        bool        _DMA_BUSY;
+        bool        _NATIVE;
+        WireFormat  _FORMAT;
+        uint32_t    _PIXEL_BYTES;
+
+        // Power management
+        enum PowerState {
+            POWER_NORMAL,
+            POWER_PARTIAL,
+            POWER_IDLE,
+            POWER_SLEEP,
+        };
+        PowerState  _POWER;
+        uint32_t    _PARTIAL_MS;
+        uint32_t    _IDLE_MS;
+        uint32_t    _SLEEP_MS;
+        uint64_t    _LAST_ACTIVITY_US;
+        uint64_t    _SLEEP_US;      // When SLPIN was sent
+        uint32_t    _WAKE_LATENCY_US;
+        int32_t     _TEXT_TOP;      // Rows with text on, from set_text_rows, or -1 if none
+        int32_t     _TEXT_BOTTOM;
+        bool        _CLEAR_ON_INIT;
+        uint32_t    _BAUDRATE;
+        uint64_t    _BOOT_US;
+        uint32_t    _FIRST_PIXEL_US;
+
+        // The display with a DMA transfer in flight on each SPI instance, so that
+        // displays sharing a bus don't talk over each other
+        static ILI9341* _BUS_OWNER[2];
+
+        // The display whose clock each SPI instance is set to. Each display
+        // keeps its own calibrated clock, applied by wait_bus when it takes
+        // over a shared instance.
+        static ILI9341* _BUS_CLOCK[2];
 
         // Private constants
         const uint8_t NOP           = 0x00;  // No-op
@@ -81,6 +207,8 @@ class ILI9341 : public I_Framebuffer<uint16_t> {
         const uint8_t VSCRDEF       = 0x33;  // Vertical scrolling definition
         const uint8_t MADCTL        = 0x36;  // Memory access control
         const uint8_t VSCRSADD      = 0x37;  // Vertical scrolling start address
+        const uint8_t IDMOFF        = 0x38;  // Idle mode off
+        const uint8_t IDMON         = 0x39;  // Idle mode on
         const uint8_t PIXFMT        = 0x3A;  // COLMOD: Pixel format set
         const uint8_t FRMCTR1       = 0xB1;  // Frame rate control (In normal mode/full colors
         const uint8_t FRMCTR2       = 0xB2;  // Frame rate control (In idle mode/8 colors
@@ -105,25 +233,229 @@ class ILI9341 : public I_Framebuffer<uint16_t> {
         const uint8_t ENABLE3G      = 0xF2;  // Enable 3 gamma control
         const uint8_t PUMPRC        = 0xF7;  // Pump ratio control
 
+        // RDMODE bits
+        const uint8_t RDMODE_BOOSTER   = 0x80;  // Booster voltage status
+        const uint8_t RDMODE_SLEEP_OUT = 0x10;  // Sleep out mode
+        const uint8_t RDMODE_NORMAL    = 0x08;  // Normal display mode; the only bit set after reset
+        const uint8_t RDMODE_DISPLAY   = 0x04;  // Display on
+
+        // Register reads are only specified up to 6.6MHz
+        const uint32_t READ_BAUDRATE = 6*1000*1000;
+
+        // COLMOD values for each WireFormat
+        const uint8_t PIXFMT_16BPP  = 0x55;
+        const uint8_t PIXFMT_18BPP  = 0x66;
+
+        // Calibration writes this many pixels per pattern, at the top of display RAM
+        static const uint32_t CALIBRATION_PIXELS = 240;
+        const uint8_t CALIBRATION_PASSES = 4;
+
+        // Waits from the datasheet. The timeouts are the worst cases, used while polling RDMODE
+        const uint32_t RESET_MIN_MS       = 5;      // After a reset or SLPOUT, before the next command
+        const uint32_t RESET_TIMEOUT_MS   = 120;    // After hardware reset, if it was applied in sleep out mode
+        const uint32_t SLPOUT_TIMEOUT_MS  = 120;    // After SLPOUT, for the supply voltages to settle
+        const uint32_t SLPIN_MIN_MS       = 120;    // After SLPIN, before SLPOUT
+
         const uint8_t DISPLAY_ROTATE_0   = 0x88;
         const uint8_t DISPLAY_ROTATE_90  = 0xE8;
         const uint8_t DISPLAY_ROTATE_180 = 0x48;
         const uint8_t DISPLAY_ROTATE_270 = 0x28;
-
-        const uint8_t PWCTRB_D[3] = {0x00, 0xC1, 0x30};
-        const uint8_t POSC_D[4] = {0x64, 0x03, 0x12, 0x81};
-        const uint8_t DTCA_D[3] = {0x85, 0x00, 0x78};
-        const uint8_t PWCTRA_D[5] = {0x39, 0x2C, 0x00, 0x34, 0x02};
-        const uint8_t DTCB_D[2] = {0x00, 0x00};
-        const uint8_t VMCTR1_D[2] = {0x3E, 0x28};
-        const uint8_t FRMCTR1_D[2] = {0x00, 0x18};
-        const uint8_t DFUNCTR_D[3] = {0x08, 0x82, 0x27};
-        const uint8_t GMCTRP1_D[15] = {0x0F, 0x31, 0x2B, 0x0C, 0x0E, 0x08, 0x4E,
-                                0xF1, 0x37, 0x07, 0x10, 0x03, 0x0E, 0x09, 0x00};
-        const uint8_t GMCTRN1_D[15] = {0x00, 0x0E, 0x14, 0x03, 0x11, 0x07, 0x31,
-                       0xC1, 0x48, 0x08, 0x0F, 0x0C, 0x31, 0x36, 0x0F};
+        const uint8_t MADCTL_MY          = 0x80;  // Row address order
+        const uint8_t MADCTL_MV          = 0x20;  // Row/column exchange
 };
+
+// The path from plot_block to the start of a pixel burst is defined here, so
+// that it can be inlined into the console that calls it. plot and set_window
+// are forced inline with the plot_block entry points, as GCC's size heuristics
+// otherwise keep them out of line.
+
+inline void ILI9341::wait_bus()
+{
+    // Finish any DMA transfer on this SPI instance, whichever display started it
+    unsigned int index = spi_get_index(_SPI);
+    ILI9341* owner = _BUS_OWNER[index];
+    if (owner)
+        owner->wait_idle();
+
+    // Displays sharing the instance may run at different clocks
+    if (_BUS_CLOCK[index] != this)
+    {
+        spi_set_baudrate(_SPI, _BAUDRATE);
+        _BUS_CLOCK[index] = this;
+    }
+}
+
+inline void ILI9341::write_cmd(uint8_t command)
+{
+    // Every transaction begins with a command, so make sure the bus is free first
+    wait_bus();
+
+    // We're writing a command, so drive the DC pin low
+    gpio_put(_DC, 0);
+
+    // CS pin is active low, drive it low while writing
+    gpio_put(_CS, 0);
+    spi_write_blocking(_SPI, &command, 1);
+    gpio_put(_CS, 1);
+}
+
+inline void ILI9341::write_data(uint8_t* args, uint32_t len)
+{
+    // We're writing data, so drive the DC pin high
+    gpio_put(_DC, 1);
+
+    // CS pin is active low, drive it low while writing
+    gpio_put(_CS, 0);
+    spi_write_blocking(_SPI, args, len);
+    gpio_put(_CS, 1);
+}
+
+inline void ILI9341_SPI::begin_data(bool frames16)
+{
+    // We're writing data, so drive the DC pin high
+    gpio_put(_DC, 1);
+
+    // 16-bit frames are sent MSB first
+    if (frames16)
+        spi_set_format(_SPI, 16, SPI_CPOL_0, SPI_CPHA_0, SPI_MSB_FIRST);
+    _FRAMES16 = frames16;
+
+    // CS pin is active low, drive it low while writing
+    gpio_put(_CS, 0);
+}
+
+inline void ILI9341_SPI::write8(const uint8_t* data, uint32_t len)
+{
+    spi_write_blocking(_SPI, data, len);
+}
+
+inline void ILI9341_SPI::write16(const uint16_t* data, uint32_t len)
+{
+    spi_write16_blocking(_SPI, data, len);
+}
+
+inline void ILI9341_SPI::end_data()
+{
+    gpio_put(_CS, 1);
+    if (_FRAMES16)
+        spi_set_format(_SPI, 8, SPI_CPOL_0, SPI_CPHA_0, SPI_MSB_FIRST);
+    _FRAMES16 = false;
+}
+
+inline bool ILI9341_SPI::start_async(const void* data, uint32_t count, bool frames16)
+{
+    if (_DMA < 0)
+        return false;
+
+    // Leave the DMA running with CS held low; finish_async releases it
+    dma_channel_config config = dma_channel_get_default_config(_DMA);
+    channel_config_set_transfer_data_size(&config, frames16 ? DMA_SIZE_16 : DMA_SIZE_8);
+    channel_config_set_dreq(&config, spi_get_dreq(_SPI, true));
+    channel_config_set_read_increment(&config, true);
+    channel_config_set_write_increment(&config, false);
+    dma_channel_configure(_DMA, &config, &spi_get_hw(_SPI)->dr, data, count, true);
+    return true;
+}
+
+inline void ILI9341_SPI::finish_async()
+{
+    // The DMA finishing only means the last byte is in the TX FIFO, so also
+    // wait for the SPI to finish shifting it out
+    dma_channel_wait_for_finish_blocking(_DMA);
+    while (spi_is_busy(_SPI))
+        tight_loop_contents();
+
+    // Nothing read the RX FIFO during the transfer; drain it and clear the overrun
+    while (spi_is_readable(_SPI))
+        (void)spi_get_hw(_SPI)->dr;
+    spi_get_hw(_SPI)->icr = SPI_SSPICR_RORIC_BITS;
+
+    end_data();
+}
+
+inline bool ILI9341::bounds(uint16_t x, uint16_t y)
+{
+    if (x < 0)
+        return false;
+    if (y < 0)
+        return false;
+    if (x > _WIDTH)
+        return false;
+    if (y > _HEIGHT)
+        return false;
     
+    return true;
+}
+
+__attribute__((always_inline)) inline void ILI9341::set_window(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1)
+{
+    uint8_t locdat[4];
+
+    FBTRACE(FBTRACE_WINDOW, spi_get_index(_SPI), x0, y0, x1, y1);
+
+    // Prepare the data for SET_COLUMN, expects big endian
+    locdat[0] = (x0 >> 8);
+    locdat[1] = (x0 & 0xFF);
+    locdat[2] = (x1 >> 8);
+    locdat[3] = (x1 & 0xFF);
+    write_cmd(SET_COLUMN);
+    write_data(locdat, 4);
+
+    // Prepare the data for SET_PAGE, expects big endian
+    locdat[0] = (y0 >> 8);
+    locdat[1] = (y0 & 0xFF);
+    locdat[2] = (y1 >> 8);
+    locdat[3] = (y1 & 0xFF);
+    write_cmd(SET_PAGE);
+    write_data(locdat, 4);
+
+    // Following data goes to display RAM
+    write_cmd(WRITE_RAM);
+}
+
+__attribute__((always_inline)) inline void ILI9341::plot(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t* pixeldata, uint32_t len, bool async)
+{
+    // Bounds check
+    if (!bounds(x0, y0))
+        return;
+    if (!bounds(x1, y1))
+        return;
+
+    // Add offset
+    y0 += _SCROLL_OFFSET;
+    y1 += _SCROLL_OFFSET;
+
+    // Check if either y0 or y1 is set beyond _HEIGHT, after applying _SCROLL_OFFSET
+    if ((y0 >= _HEIGHT) || (y1 >= _HEIGHT))
+    {
+        // If either y0 or y1 is beyond the framebuffer memory, but the other is not, place two draw calls.
+        if (!((y0 >= _HEIGHT) && (y1 >= _HEIGHT)))
+        {
+            plot_wrapped(x0, y0, x1, y1, pixeldata, len, async);
+            return;
+        }
+
+        // Both y0 and y1 are beyond _HEIGHT, after applying _SCROLL_OFFSET, so just account for that and wrap.
+        y0 %= _HEIGHT;
+        y1 %= _HEIGHT;
+    }
+
+    // Write the desired pixel data
+    set_window(x0, y0, x1, y1);
+    write_pixels(pixeldata, len, async);
+    mark_first_pixel();
+}
+
+__attribute__((always_inline)) inline void ILI9341::plot_block(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t* pixeldata, uint32_t len)
+{
+    wake();
+    plot(x0, y0, x1, y1, pixeldata, len, false);
+}
 
+__attribute__((always_inline)) inline void ILI9341::plot_block_async(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t* pixeldata, uint32_t len)
+{
+    wake();
+    plot(x0, y0, x1, y1, pixeldata, len, true);
+}
 
 #endif
\ No newline at end of file
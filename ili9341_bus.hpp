@@ -0,0 +1,81 @@
+// Copyright 2021 Dominic Houghton. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+/* ILI9341 pixel write path, over a pluggable bus
+
+ * ili9341_write_pixels decides how a block of RGB565 pixels goes over the
+ * wire: as 16-bit frames in native endian mode, as a plain byte stream when
+ * the pixels are already byte-swapped, or packed into RGB666 in strips. The
+ * bus only moves data, so the path can be run on the host against a
+ * recording bus (see tests/test_ili9341_bus.cpp).
+ *
+ * The function is a template over the bus type, like FBConsole over its
+ * framebuffer: ILI9341 passes its final ILI9341_SPI bus, so the calls are
+ * made directly and can be inlined.
+ */
+
+#ifndef ILI9341_BUS_H
+#define ILI9341_BUS_H
+
+#include <stdint.h>
+#include "rgb565.hpp"
+
+class ILI9341_Bus {
+    public:
+        // Starts a data transaction (DC high, CS low), in 16-bit frames if frames16
+        virtual void begin_data(bool frames16) = 0;
+        // Send within a transaction; frames are sent most significant byte first
+        virtual void write8(const uint8_t* data, uint32_t len) = 0;
+        virtual void write16(const uint16_t* data, uint32_t len) = 0;
+        // Ends the transaction, returning to 8-bit frames
+        virtual void end_data() = 0;
+
+        // Starts sending count frames in the background, leaving the
+        // transaction open until the transfer is waited for. Returns false,
+        // having sent nothing, if the bus can't.
+        virtual bool start_async(const void* data, uint32_t count, bool frames16) = 0;
+};
+
+// Pixels packed per strip for RGB666
+static const uint32_t ILI9341_PACK_PIXELS = 64;
+
+// Sends len pixels as data. native is true if the pixels are native RGB565,
+// false if they are byte-swapped as the display expects them. Returns true if
+// the transfer was left running in the background (only if async is set).
+template <class Bus>
+inline bool ili9341_write_pixels(Bus* bus, const uint16_t* pixeldata, uint32_t len,
+                                 bool native, bool rgb666, bool async)
+{
+    if (rgb666)
+    {
+        // Packed strips are sent blocking, in one transaction
+        uint8_t wire[ILI9341_PACK_PIXELS * 3];
+        bus->begin_data(false);
+        while (len > 0)
+        {
+            uint32_t strip = (len < ILI9341_PACK_PIXELS) ? len : ILI9341_PACK_PIXELS;
+            bus->write8(wire, rgb565_pack_rgb666(pixeldata, strip, wire, !native));
+            pixeldata += strip;
+            len -= strip;
+        }
+        bus->end_data();
+        return false;
+    }
+
+    // Native pixels go out as 16-bit frames, most significant byte first.
+    // Byte-swapped pixels are already in the order the display expects, so
+    // they can be sent as plain bytes.
+    bus->begin_data(native);
+    if (async && bus->start_async(pixeldata, native ? len : len * 2, native))
+        return true;
+
+    if (native)
+        bus->write16(pixeldata, len);
+    else
+        bus->write8((const uint8_t*)pixeldata, len * 2);
+    bus->end_data();
+    return false;
+}
+
+#endif
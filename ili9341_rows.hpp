@@ -0,0 +1,42 @@
+// Copyright 2021 Dominic Houghton. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+/* ILI9341 display RAM row mapping, for the partial area
+
+ * Drawing addresses rows by page, and plot adds the scroll offset to the
+ * logical row, so logical row y is page (y + offset) % height. MADCTL's MY
+ * bit reverses the page order in display RAM, so with MY set page p is
+ * stored in RAM row height - 1 - p. PTLAR takes RAM rows, so the text rows
+ * have to be converted both ways before partial mode can show them.
+ *
+ * Kept free of the Pico SDK so it can be tested on the host (see
+ * tests/test_ili9341_rows.cpp).
+ */
+
+#ifndef ILI9341_ROWS_H
+#define ILI9341_ROWS_H
+
+#include <stdint.h>
+
+// The display RAM row holding logical row y
+inline uint16_t ili9341_ram_row(uint16_t y, uint16_t height, uint16_t offset, bool mirrored)
+{
+    uint16_t page = (uint16_t)((y + offset) % height);
+    return mirrored ? (uint16_t)(height - 1 - page) : page;
+}
+
+// The PTLAR start and end rows covering logical rows top to bottom. With MY
+// set the rows are reversed, so the bottom row gives the start. If the area
+// wraps past the end of RAM, start ends up after end, which the controller
+// handles by wrapping the partial area too.
+inline void ili9341_partial_area(int32_t top, int32_t bottom, uint16_t height, uint16_t offset,
+                                 bool mirrored, uint16_t* start, uint16_t* end)
+{
+    uint16_t first = ili9341_ram_row((uint16_t)top, height, offset, mirrored);
+    uint16_t last = ili9341_ram_row((uint16_t)bottom, height, offset, mirrored);
+    *start = mirrored ? last : first;
+    *end = mirrored ? first : last;
+}
+
+#endif
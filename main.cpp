@@ -32,12 +32,39 @@ int main()
     // Test printf
     printf("Hello world!\n\n%s\nint: %i\thex: %X\n\nThe framebuffer console driver supports wrapping. Terminal emulation to come.\n\n", "The meaning of life:", 42, 42);
 
+    // Report how long display bring-up took, and the worst wake from power saving so far
+    printf("Time to first pixel: %lu us\n", (unsigned long)fb_first_pixel_us());
+    printf("Wake latency: %lu us\n\n", (unsigned long)fb_wake_latency_us());
+
+    // Counter ticker; only the parts of each digit that change are redrawn
+    uint32_t sent, saved;
+    for (int i = 0; i <= 1000; i++)
+    {
+        printf("\rTicker: %4d", i);
+        fb_poll();
+    }
+    fb_get_stats(&sent, &saved);
+    printf("\nPixels sent: %lu saved: %lu\n", (unsigned long)sent, (unsigned long)saved);
+    printf("Pixel bytes over SPI: %lu\n", (unsigned long)fb_pixel_bytes());
+
+    // Report how compact the screen mirror stream is
+    uint32_t updates, bytes;
+    fb_mirror_stats(&updates, &bytes);
+    printf("Mirror: %lu bytes for %lu updates (%lu.%02lu per update)\n\n",
+           (unsigned long)bytes, (unsigned long)updates,
+           (unsigned long)(updates ? (bytes / updates) : 0),
+           (unsigned long)(updates ? (((bytes % updates) * 100) / updates) : 0));
+
     printf("Nope");
     __breakpoint();
     printf("\b\b\b\b    ");
 
-    // Break, and halt execution
+    // Send the display trace to the host, if tracing is built in
+    fb_trace_dump();
+
+    // Break, then idle; the displays power down when nothing is printed
     __breakpoint();
-    for(;;);
+    for(;;)
+        fb_poll();
     return 0;
 }
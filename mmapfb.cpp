@@ -0,0 +1,232 @@
+// Copyright 2021 Dominic Houghton. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Memory-mapped framebuffer for Linux hosts, conforming to I_Framebuffer interface
+
+#include "mmapfb.hpp"
+#include "rgb565.hpp"
+#include "FBConsole_impl.hpp"
+#include "FBTerminals_impl.hpp"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+template <class T>
+MmapFramebuffer<T>::MmapFramebuffer(const char* path, uint16_t width, uint16_t height)
+{
+    _MAP = 0;
+    _HEADER = 0;
+    _WIDTH = width;
+    _HEIGHT = height;
+    _STRIDE = width * sizeof(T);
+    _SCROLL_OFFSET = 0;
+    _PAN = false;
+    _RESTORE_VAR = false;
+
+    // Size the file for the header and pixels, then map all of it
+    _MAP_SIZE = sizeof(mmapfb_header) + (_STRIDE * _HEIGHT);
+    _FD = open(path, O_RDWR | O_CREAT, 0644);
+    if (_FD < 0)
+        return;
+    if (ftruncate(_FD, _MAP_SIZE) != 0)
+        return;
+
+    void* map = mmap(0, _MAP_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, _FD, 0);
+    if (map == MAP_FAILED)
+        return;
+    _MAP = (uint8_t*)map;
+    _HEADER = (mmapfb_header*)_MAP;
+    _PIXELS = _MAP + sizeof(mmapfb_header);
+
+    // Start from a blank screen, unless the file already holds one this shape
+    if ((_HEADER->magic != MMAPFB_MAGIC) || (_HEADER->width != _WIDTH) ||
+        (_HEADER->height != _HEIGHT) || (_HEADER->stride != _STRIDE))
+    {
+        memset(_MAP, 0, _MAP_SIZE);
+        _HEADER->version = MMAPFB_VERSION;
+        _HEADER->header_size = sizeof(mmapfb_header);
+        _HEADER->width = _WIDTH;
+        _HEADER->height = _HEIGHT;
+        _HEADER->format = (sizeof(T) == 2) ? MMAPFB_RGB565 : MMAPFB_XRGB8888;
+        _HEADER->stride = _STRIDE;
+        _HEADER->scroll = 0;
+        _HEADER->frame = 0;
+
+        // Written last, so viewers never see a half-written header
+        __sync_synchronize();
+        _HEADER->magic = MMAPFB_MAGIC;
+    }
+    _SCROLL_OFFSET = _HEADER->scroll % _HEIGHT;
+}
+
+template <class T>
+MmapFramebuffer<T>::MmapFramebuffer(const char* path)
+{
+    fb_var_screeninfo var;
+    fb_fix_screeninfo fix;
+
+    _MAP = 0;
+    _HEADER = 0;
+    _SCROLL_OFFSET = 0;
+    _PAN = false;
+    _RESTORE_VAR = false;
+
+    _FD = open(path, O_RDWR);
+    if (_FD < 0)
+        return;
+    if ((ioctl(_FD, FBIOGET_VSCREENINFO, &var) != 0) ||
+        (ioctl(_FD, FBIOGET_FSCREENINFO, &fix) != 0))
+        return;
+    if (!format_matches(var))
+        return;
+    _DEVICE_VAR = var;
+
+    _WIDTH = var.xres;
+    _HEIGHT = var.yres;
+    _STRIDE = fix.line_length;
+
+    // Panning needs a second screen's worth of rows below the first
+    if (var.yres_virtual < (var.yres * 2))
+    {
+        var.yres_virtual = var.yres * 2;
+        _RESTORE_VAR = true;
+        ioctl(_FD, FBIOPUT_VSCREENINFO, &var);
+        ioctl(_FD, FBIOGET_VSCREENINFO, &var);
+        ioctl(_FD, FBIOGET_FSCREENINFO, &fix);
+    }
+    _PAN = (var.yres_virtual >= (var.yres * 2));
+
+    _MAP_SIZE = fix.smem_len;
+    void* map = mmap(0, _MAP_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, _FD, 0);
+    if (map == MAP_FAILED)
+        return;
+    _MAP = (uint8_t*)map;
+    _PIXELS = _MAP;
+}
+
+template <class T>
+MmapFramebuffer<T>::~MmapFramebuffer()
+{
+    if (_MAP)
+        munmap(_MAP, _MAP_SIZE);
+    if (_RESTORE_VAR)
+        ioctl(_FD, FBIOPUT_VSCREENINFO, &_DEVICE_VAR);
+    if (_FD >= 0)
+        close(_FD);
+}
+
+// True if the device's pixels are laid out as T expects: RGB565, or XRGB8888
+template <class T>
+bool MmapFramebuffer<T>::format_matches(const fb_var_screeninfo& var)
+{
+    // Offset and length of red, green and blue
+    static const uint32_t RGB565[6] = { 11, 5, 5, 6, 0, 5 };
+    static const uint32_t XRGB8888[6] = { 16, 8, 8, 8, 0, 8 };
+    const uint32_t* expected = (sizeof(T) == 2) ? RGB565 : XRGB8888;
+    const fb_bitfield* fields[3] = { &var.red, &var.green, &var.blue };
+
+    if ((var.bits_per_pixel != (sizeof(T) * 8)) || var.grayscale || var.nonstd)
+        return false;
+    for (int i = 0; i < 3; i++)
+    {
+        if ((fields[i]->offset != expected[i * 2]) || (fields[i]->length != expected[(i * 2) + 1]) ||
+            fields[i]->msb_right)
+            return false;
+    }
+    return true;
+}
+
+template <class T>
+bool MmapFramebuffer<T>::is_open()
+{
+    return _MAP != 0;
+}
+
+template <class T>
+T MmapFramebuffer<T>::get_color(uint8_t r, uint8_t g, uint8_t b)
+{
+    if (sizeof(T) == 2)
+        return rgb565(r, g, b);
+    return (T)(0xFF000000 | (r << 16) | (g << 8) | b);
+}
+
+template <class T>
+void MmapFramebuffer<T>::get_dimensions(uint16_t* width, uint16_t* height)
+{
+    *width = _WIDTH;
+    *height = _HEIGHT;
+}
+
+template <class T>
+T* MmapFramebuffer<T>::row(uint32_t y)
+{
+    return (T*)(_PIXELS + (y * _STRIDE));
+}
+
+template <class T>
+void MmapFramebuffer<T>::plot_block(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, T* pixeldata, uint32_t len)
+{
+    // Bounds check
+    if ((x1 >= _WIDTH) || (y1 >= _HEIGHT) || (x0 > x1) || (y0 > y1))
+        return;
+
+    uint32_t width = x1 - x0 + 1;
+    uint32_t bytes = width * sizeof(T);
+    for (uint32_t y = y0; (y <= y1) && (len >= width); y++)
+    {
+        // Find this logical row in the ring
+        uint32_t ring = (y + _SCROLL_OFFSET) % _HEIGHT;
+        memcpy(&row(ring)[x0], pixeldata, bytes);
+        if (_PAN)
+            memcpy(&row(ring + _HEIGHT)[x0], pixeldata, bytes);
+
+        pixeldata += width;
+        len -= width;
+    }
+
+    if (_HEADER)
+        _HEADER->frame++;
+}
+
+template <class T>
+void MmapFramebuffer<T>::scroll_vertical(uint16_t pixels)
+{
+    pixels %= _HEIGHT;
+    _SCROLL_OFFSET = (_SCROLL_OFFSET + pixels) % _HEIGHT;
+
+    if (_HEADER)
+    {
+        // Viewers unroll the ring themselves
+        _HEADER->scroll = _SCROLL_OFFSET;
+        _HEADER->frame++;
+    }
+    else if (_PAN)
+    {
+        fb_var_screeninfo var;
+        if (ioctl(_FD, FBIOGET_VSCREENINFO, &var) == 0)
+        {
+            var.yoffset = _SCROLL_OFFSET;
+            _RESTORE_VAR = true;
+            ioctl(_FD, FBIOPAN_DISPLAY, &var);
+        }
+    }
+    else
+    {
+        // The device can't show the ring, so move the rows after all
+        memmove(_PIXELS, _PIXELS + (pixels * _STRIDE), (_HEIGHT - pixels) * _STRIDE);
+        _SCROLL_OFFSET = 0;
+    }
+}
+
+template class MmapFramebuffer<uint16_t>;
+template class MmapFramebuffer<uint32_t>;
+
+// Statically dispatched consoles, for profiling the console without virtual calls
+template class FBConsole<uint16_t, MmapFramebuffer<uint16_t>>;
+template class FBConsole<uint32_t, MmapFramebuffer<uint32_t>>;
+template class FBTerminals<uint16_t, MmapFramebuffer<uint16_t>>;
+template class FBTerminals<uint32_t, MmapFramebuffer<uint32_t>>;
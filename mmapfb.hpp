@@ -0,0 +1,94 @@
+// Copyright 2021 Dominic Houghton. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Memory-mapped framebuffer for Linux hosts, conforming to I_Framebuffer interface
+
+/* Writes pixels straight into memory-mapped display memory, for soak testing
+ * and profiling FBConsole at host speed. Two kinds of target are supported:
+ * 
+ * - A plain file, created with an mmapfb_header in front of the pixels, which
+ *   other tools can map and view while the console is running.
+ * - A Linux framebuffer device such as /dev/fb0.
+ * 
+ * scroll_vertical doesn't move any pixels. Display memory is treated as a
+ * ring of rows, and logical row 0 is stored at row `scroll`. For files, the
+ * offset is published in the header. For devices with a virtual height of at
+ * least twice the visible height, each row is also written a screen height
+ * further down, and the display is panned to the offset; other devices fall
+ * back to moving the rows.
+ * 
+ * T selects the pixel format: uint16_t for RGB565, uint32_t for XRGB8888.
+ * Devices in any other channel layout are refused. Any change made to a
+ * device's mode (the virtual height, and the pan offset) is undone when the
+ * framebuffer is destroyed.
+ * This is host-only code, built by tests/CMakeLists.txt.
+ */
+
+#ifndef MMAPFB_H
+#define MMAPFB_H
+
+#include <stdint.h>
+#include <linux/fb.h>
+#include "I_Framebuffer.hpp"
+
+#define MMAPFB_MAGIC    0x4D434246  // "FBCM", little endian
+#define MMAPFB_VERSION  1
+
+enum mmapfb_format {
+    MMAPFB_RGB565   = 0,
+    MMAPFB_XRGB8888 = 1,
+};
+
+// Placed at the start of a framebuffer file; the pixels follow at header_size
+struct mmapfb_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;       // Offset of the pixel data
+    uint16_t width;
+    uint16_t height;
+    uint32_t format;            // mmapfb_format
+    uint32_t stride;            // Bytes per row
+    volatile uint32_t scroll;   // Display memory row holding logical row 0
+    volatile uint32_t frame;    // Incremented after every update, for viewers to poll
+};
+
+template <class T>
+class MmapFramebuffer final : public I_Framebuffer<T> {
+    public:
+        // Creates (or reuses, if the geometry matches) a framebuffer file
+        MmapFramebuffer(const char* path, uint16_t width, uint16_t height);
+        // Opens a Linux framebuffer device, which must be RGB565 for uint16_t or XRGB8888 for uint32_t
+        MmapFramebuffer(const char* path);
+        ~MmapFramebuffer();
+        MmapFramebuffer(const MmapFramebuffer&) = delete;
+        MmapFramebuffer& operator=(const MmapFramebuffer&) = delete;
+
+        // False if the file or device couldn't be opened and mapped
+        bool is_open();
+
+        T get_color(uint8_t r, uint8_t g, uint8_t b);
+        void get_dimensions(uint16_t* width, uint16_t* height);
+
+        void plot_block(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, T* pixeldata, uint32_t len);
+        void scroll_vertical(uint16_t pixels);
+
+    private:
+        T* row(uint32_t y);
+        static bool format_matches(const fb_var_screeninfo& var);
+
+        int         _FD;
+        uint8_t*    _MAP;
+        uint32_t    _MAP_SIZE;
+        mmapfb_header* _HEADER;     // Only for files
+        uint8_t*    _PIXELS;
+        uint16_t    _WIDTH;
+        uint16_t    _HEIGHT;
+        uint32_t    _STRIDE;
+        uint32_t    _SCROLL_OFFSET;
+        bool        _PAN;           // Device rows are mirrored one screen down, and the display panned
+        fb_var_screeninfo _DEVICE_VAR;  // The device's mode when opened
+        bool        _RESTORE_VAR;   // The mode has been changed since, and needs restoring
+};
+
+#endif
@@ -0,0 +1,77 @@
+// Copyright 2021 Dominic Houghton. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+/* RGB565 colour helpers
+
+ * All functions work on native-endian RGB565 values, i.e. red in bits 15-11,
+ * green in bits 10-5 and blue in bits 4-0 of a uint16_t, so that ordinary
+ * arithmetic applies. Use rgb565_swap to convert to or from the big-endian
+ * byte order some displays expect when fed a byte stream.
+ */
+
+#ifndef RGB565_H
+#define RGB565_H
+
+#include <stdint.h>
+
+inline uint16_t rgb565(uint8_t r, uint8_t g, uint8_t b)
+{
+    return ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+}
+
+inline uint8_t rgb565_red(uint16_t color)
+{
+    uint8_t r = (color >> 11) & 0x1F;
+    return (r << 3) | (r >> 2);
+}
+
+inline uint8_t rgb565_green(uint16_t color)
+{
+    uint8_t g = (color >> 5) & 0x3F;
+    return (g << 2) | (g >> 4);
+}
+
+inline uint8_t rgb565_blue(uint16_t color)
+{
+    uint8_t b = color & 0x1F;
+    return (b << 3) | (b >> 2);
+}
+
+// Blend from a to b; alpha 0 gives a, alpha 256 gives b
+inline uint16_t rgb565_blend(uint16_t a, uint16_t b, uint16_t alpha)
+{
+    // Spread the channels out so all three can be blended with one multiply:
+    // 0b00000gggggg00000rrrrr000000bbbbb
+    // Each field has 5 bits of headroom above it for the 0-32 weights.
+    uint32_t wa = (a | ((uint32_t)a << 16)) & 0x07E0F81F;
+    uint32_t wb = (b | ((uint32_t)b << 16)) & 0x07E0F81F;
+    uint32_t weight = alpha >> 3;
+    uint32_t w = ((wa * (32 - weight) + wb * weight) >> 5) & 0x07E0F81F;
+    return (uint16_t)(w | (w >> 16));
+}
+
+inline uint16_t rgb565_swap(uint16_t color)
+{
+    return (color >> 8) | (color << 8);
+}
+
+// Packs pixels into RGB666 as sent to 18-bit display interfaces: one byte per
+// channel, in its top 6 bits. The low bit of the 5-bit channels is filled
+// from their top bit, so white stays white. Set swapped if the pixels are
+// byte-swapped. Returns the number of bytes written, 3 per pixel.
+inline uint32_t rgb565_pack_rgb666(const uint16_t* pixels, uint32_t len, uint8_t* out, bool swapped)
+{
+    for (uint32_t i = 0; i < len; i++)
+    {
+        uint16_t color = swapped ? rgb565_swap(pixels[i]) : pixels[i];
+        uint8_t r = (color >> 11) & 0x1F;
+        uint8_t b = color & 0x1F;
+        out[(i * 3) + 0] = (r << 3) | ((r >> 4) << 2);
+        out[(i * 3) + 1] = (color >> 3) & 0xFC;
+        out[(i * 3) + 2] = (b << 3) | ((b >> 4) << 2);
+    }
+    return len * 3;
+}
+
+#endif
@@ -0,0 +1,271 @@
+// Copyright 2021 Dominic Houghton. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// SSD1306 monochrome OLED driver for Raspberry Pico, conforming to I_Framebuffer interface
+
+#include "ssd1306.hpp"
+#include "FBConsole_impl.hpp"
+#include "FBTerminals_impl.hpp"
+
+#include <stdint.h>
+#include <string.h>
+
+// Initialisation sequence. The multiplex ratio (0xA8) and COM pins (0xDA)
+// depend on the panel height, and are sent separately.
+static const uint8_t INIT_SEQUENCE[] = {
+    0xAE,           // Display off
+    0xD5, 0x80,     // Clock divide ratio / oscillator frequency
+    0xD3, 0x00,     // Display offset
+    0x40,           // Display start line 0
+    0x8D, 0x14,     // Charge pump on
+    0x20, 0x00,     // Horizontal addressing mode
+    0xA1,           // Segment remap, column 127 is SEG0
+    0xC8,           // COM scan direction remapped
+    0x81, 0xCF,     // Contrast
+    0xD9, 0xF1,     // Pre-charge period
+    0xDB, 0x40,     // VCOMH deselect level
+    0xA4,           // Display follows RAM
+    0xA6,           // Normal, not inverted
+};
+
+SSD1306::SSD1306(SSD1306_Bus* bus, uint16_t width, uint16_t height)
+{
+    _BUS = bus;
+    _WIDTH = width;
+    _HEIGHT = height;
+    _PAGES = height / 8;
+    _AUTOFLUSH = true;
+
+    _SHADOW = new uint8_t[_WIDTH * _PAGES];
+    _DIRTY_X0 = new uint16_t[_PAGES];
+    _DIRTY_X1 = new uint16_t[_PAGES];
+    for (uint16_t page = 0; page < _PAGES; page++)
+    {
+        _DIRTY_X0[page] = NOT_DIRTY;
+        _DIRTY_X1[page] = NOT_DIRTY;
+    }
+
+    reset();
+}
+
+SSD1306::~SSD1306()
+{
+    delete[] _SHADOW;
+    delete[] _DIRTY_X0;
+    delete[] _DIRTY_X1;
+}
+
+void SSD1306::reset()
+{
+    uint8_t geometry[4] = {
+        0xA8, (uint8_t)(_HEIGHT - 1),                   // Multiplex ratio
+        0xDA, (uint8_t)((_HEIGHT == 64) ? 0x12 : 0x02)  // COM pins configuration
+    };
+    uint8_t display_on = 0xAF;
+
+    _BUS->write_commands(INIT_SEQUENCE, sizeof(INIT_SEQUENCE));
+    _BUS->write_commands(geometry, sizeof(geometry));
+
+    // Clear display RAM before turning the display on
+    clear();
+    _BUS->write_commands(&display_on, 1);
+}
+
+uint8_t SSD1306::get_color(uint8_t r, uint8_t g, uint8_t b)
+{
+    // Anything at least half brightness is on
+    return (((r * 77) + (g * 150) + (b * 29)) >= (128 * 256)) ? 1 : 0;
+}
+
+void SSD1306::get_dimensions(uint16_t* width, uint16_t* height)
+{
+    *width = _WIDTH;
+    *height = _HEIGHT;
+}
+
+void SSD1306::mark_dirty(uint16_t page, uint16_t x0, uint16_t x1)
+{
+    if ((_DIRTY_X0[page] == NOT_DIRTY) || (x0 < _DIRTY_X0[page]))
+        _DIRTY_X0[page] = x0;
+    if ((_DIRTY_X1[page] == NOT_DIRTY) || (x1 > _DIRTY_X1[page]))
+        _DIRTY_X1[page] = x1;
+}
+
+void SSD1306::plot_block(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint8_t* pixeldata, uint32_t len)
+{
+    // Bounds check
+    if ((x1 >= _WIDTH) || (y1 >= _HEIGHT) || (x0 > x1) || (y0 > y1))
+        return;
+
+    uint16_t width = x1 - x0 + 1;
+    for (uint32_t i = 0; i < len; i++)
+    {
+        uint16_t x = x0 + (i % width);
+        uint16_t y = y0 + (i / width);
+        if (y > y1)
+            break;
+
+        uint8_t bit = 1 << (y & 7);
+        if (pixeldata[i])
+            _SHADOW[((y >> 3) * _WIDTH) + x] |= bit;
+        else
+            _SHADOW[((y >> 3) * _WIDTH) + x] &= ~bit;
+    }
+
+    for (uint16_t page = (y0 >> 3); page <= (y1 >> 3); page++)
+        mark_dirty(page, x0, x1);
+
+    if (_AUTOFLUSH)
+        flush();
+}
+
+void SSD1306::write_column(uint16_t x, uint16_t y, uint8_t column)
+{
+    // Place 8 vertical pixels starting at y, which may straddle two pages
+    uint16_t page = y >> 3;
+    uint8_t shift = y & 7;
+
+    uint8_t* dest = &_SHADOW[(page * _WIDTH) + x];
+    *dest = (*dest & ~(0xFF << shift)) | (column << shift);
+
+    if (shift && ((page + 1) < _PAGES))
+    {
+        dest += _WIDTH;
+        *dest = (*dest & ~(0xFF >> (8 - shift))) | (column >> (8 - shift));
+    }
+}
+
+bool SSD1306::plot_glyph(uint16_t x, uint16_t y, const uint8_t* glyph, uint8_t scale, uint8_t foreground, uint8_t background)
+{
+    // Scaled glyphs go through plot_block
+    if ((scale != 1) || ((x + 7) >= _WIDTH) || ((y + 7) >= _HEIGHT))
+        return false;
+
+    // Load the glyph's rows into one word, row 0 in the low byte
+    uint64_t rows = 0;
+    for (int i = 0; i < 8; i++)
+        rows |= (uint64_t)glyph[i] << (i * 8);
+
+    // Transpose the 8x8 bit matrix, so that each byte holds a column with the
+    // top row in the least significant bit, as the SSD1306 expects
+    uint64_t t;
+    t = (rows ^ (rows >> 7)) & 0x00AA00AA00AA00AAULL;
+    rows = rows ^ t ^ (t << 7);
+    t = (rows ^ (rows >> 14)) & 0x0000CCCC0000CCCCULL;
+    rows = rows ^ t ^ (t << 14);
+    t = (rows ^ (rows >> 28)) & 0x00000000F0F0F0F0ULL;
+    rows = rows ^ t ^ (t << 28);
+
+    // Apply the colours: set pixels become the foreground, clear the background
+    uint64_t fg = foreground ? ~0ULL : 0;
+    uint64_t bg = background ? ~0ULL : 0;
+    rows = (rows & fg) | (~rows & bg);
+
+    // The leftmost column ended up in the most significant byte
+    for (int cx = 0; cx < 8; cx++)
+        write_column(x + cx, y, (uint8_t)(rows >> ((7 - cx) * 8)));
+
+    mark_dirty(y >> 3, x, x + 7);
+    if ((y & 7) && (((y >> 3) + 1) < _PAGES))
+        mark_dirty((y >> 3) + 1, x, x + 7);
+
+    if (_AUTOFLUSH)
+        flush();
+    return true;
+}
+
+void SSD1306::scroll_vertical(uint16_t pixels)
+{
+    pixels %= _HEIGHT;
+    if (pixels == 0)
+        return;
+
+    if ((pixels & 7) == 0)
+    {
+        // Whole pages; move the page rows and blank the bottom
+        uint16_t pages = pixels >> 3;
+        memmove(_SHADOW, &_SHADOW[pages * _WIDTH], (_PAGES - pages) * _WIDTH);
+        memset(&_SHADOW[(_PAGES - pages) * _WIDTH], 0, pages * _WIDTH);
+    }
+    else if (_HEIGHT <= 64)
+    {
+        // Gather each column into one word, top row in the least significant
+        // bit, and shift it up in one go
+        for (uint16_t x = 0; x < _WIDTH; x++)
+        {
+            uint64_t column = 0;
+            for (uint16_t page = 0; page < _PAGES; page++)
+                column |= (uint64_t)_SHADOW[(page * _WIDTH) + x] << (page * 8);
+
+            column >>= pixels;
+
+            for (uint16_t page = 0; page < _PAGES; page++)
+                _SHADOW[(page * _WIDTH) + x] = (uint8_t)(column >> (page * 8));
+        }
+    }
+    else
+    {
+        // Taller panels don't fit a column in a word; shift a page pair at a time
+        uint16_t pages = pixels >> 3;
+        uint8_t shift = pixels & 7;
+        for (uint16_t page = 0; page < _PAGES; page++)
+        {
+            for (uint16_t x = 0; x < _WIDTH; x++)
+            {
+                uint16_t src = page + pages;
+                uint8_t lo = (src < _PAGES) ? _SHADOW[(src * _WIDTH) + x] : 0;
+                uint8_t hi = ((src + 1) < _PAGES) ? _SHADOW[((src + 1) * _WIDTH) + x] : 0;
+                _SHADOW[(page * _WIDTH) + x] = (lo >> shift) | (hi << (8 - shift));
+            }
+        }
+    }
+
+    for (uint16_t page = 0; page < _PAGES; page++)
+        mark_dirty(page, 0, _WIDTH - 1);
+
+    if (_AUTOFLUSH)
+        flush();
+}
+
+void SSD1306::clear(uint8_t color)
+{
+    memset(_SHADOW, color ? 0xFF : 0x00, _WIDTH * _PAGES);
+    for (uint16_t page = 0; page < _PAGES; page++)
+        mark_dirty(page, 0, _WIDTH - 1);
+    flush();
+}
+
+void SSD1306::set_autoflush(bool autoflush)
+{
+    _AUTOFLUSH = autoflush;
+}
+
+void SSD1306::flush()
+{
+    uint8_t window[6];
+
+    for (uint16_t page = 0; page < _PAGES; page++)
+    {
+        if (_DIRTY_X0[page] == NOT_DIRTY)
+            continue;
+
+        // Set the window to the dirty columns of this page, then send them
+        window[0] = SET_COLUMN;
+        window[1] = _DIRTY_X0[page];
+        window[2] = _DIRTY_X1[page];
+        window[3] = SET_PAGE;
+        window[4] = page;
+        window[5] = page;
+        _BUS->write_commands(window, 6);
+        _BUS->write_data(&_SHADOW[(page * _WIDTH) + _DIRTY_X0[page]],
+                         _DIRTY_X1[page] - _DIRTY_X0[page] + 1);
+
+        _DIRTY_X0[page] = NOT_DIRTY;
+        _DIRTY_X1[page] = NOT_DIRTY;
+    }
+}
+
+// Statically dispatched consoles, compiled here so plot_glyph can be inlined into them
+template class FBConsole<uint8_t, SSD1306>;
+template class FBTerminals<uint8_t, SSD1306>;
@@ -0,0 +1,74 @@
+// Copyright 2021 Dominic Houghton. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// SSD1306 monochrome OLED driver for Raspberry Pico, conforming to I_Framebuffer interface
+
+/* The SSD1306 stores 8 vertical pixels per byte, in pages of 8 rows. This
+ * driver keeps a 1bpp shadow of display RAM (1KB for 128x64), and only sends
+ * the column range of each page that has changed since the last flush.
+ * 
+ * Pixels are uint8_t, 0 for off and 1 for on. FBConsole glyphs are drawn
+ * through plot_glyph, which transposes the font's rows into page columns
+ * with word operations rather than expanding them to one byte per pixel.
+ * 
+ * The bus is pluggable; SSD1306_I2C (ssd1306_i2c.hpp) drives the common I2C
+ * modules. The driver itself has no hardware dependencies.
+ */
+
+#ifndef SSD1306_H
+#define SSD1306_H
+
+#include "I_Framebuffer.hpp"
+
+class SSD1306_Bus {
+    public:
+        virtual void write_commands(const uint8_t* commands, uint32_t len) = 0;
+        virtual void write_data(const uint8_t* data, uint32_t len) = 0;
+};
+
+class SSD1306 final : public I_Framebuffer<uint8_t> {
+    public:
+        SSD1306(SSD1306_Bus* bus, uint16_t width=128, uint16_t height=64);
+        ~SSD1306();
+        SSD1306(const SSD1306&) = delete;
+        SSD1306& operator=(const SSD1306&) = delete;
+        void reset();
+
+        uint8_t get_color(uint8_t r, uint8_t g, uint8_t b);
+        void get_dimensions(uint16_t* width, uint16_t* height);
+
+        // len is expected in pixels, one byte per pixel
+        void plot_block(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint8_t* pixeldata, uint32_t len);
+        bool plot_glyph(uint16_t x, uint16_t y, const uint8_t* glyph, uint8_t scale, uint8_t foreground, uint8_t background);
+
+        void scroll_vertical(uint16_t pixels);
+        void clear(uint8_t color = 0);
+
+        // With autoflush on (the default), every drawing call ends with a flush.
+        // Turn it off to batch several calls, then call flush.
+        void set_autoflush(bool autoflush);
+        void flush();
+
+    private:
+        void mark_dirty(uint16_t page, uint16_t x0, uint16_t x1);
+        void write_column(uint16_t x, uint16_t y, uint8_t column);
+
+        SSD1306_Bus* _BUS;
+        uint16_t    _WIDTH;
+        uint16_t    _HEIGHT;
+        uint16_t    _PAGES;
+        bool        _AUTOFLUSH;
+
+        // Shadow of display RAM, page by page, and the dirty column range of each page
+        uint8_t*    _SHADOW;
+        uint16_t*   _DIRTY_X0;
+        uint16_t*   _DIRTY_X1;
+
+        // Private constants
+        const uint8_t SET_COLUMN    = 0x21;  // Column address set
+        const uint8_t SET_PAGE      = 0x22;  // Page address set
+        const uint16_t NOT_DIRTY    = 0xFFFF;
+};
+
+#endif
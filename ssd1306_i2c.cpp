@@ -0,0 +1,50 @@
+// Copyright 2021 Dominic Houghton. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// I2C bus for the SSD1306 driver, for the common I2C OLED modules
+
+#include "ssd1306_i2c.hpp"
+
+#include "pico/stdlib.h"
+
+#include <string.h>
+
+SSD1306_I2C::SSD1306_I2C(i2c_inst_t* i2cport, uint8_t sda, uint8_t scl, uint8_t address, uint32_t baudrate)
+{
+    _I2C = i2cport;
+    _ADDRESS = address;
+
+    i2c_init(_I2C, baudrate);
+    gpio_set_function(sda, GPIO_FUNC_I2C);
+    gpio_set_function(scl, GPIO_FUNC_I2C);
+    gpio_pull_up(sda);
+    gpio_pull_up(scl);
+}
+
+void SSD1306_I2C::write_commands(const uint8_t* commands, uint32_t len)
+{
+    write(CONTROL_COMMAND, commands, len);
+}
+
+void SSD1306_I2C::write_data(const uint8_t* data, uint32_t len)
+{
+    write(CONTROL_DATA, data, len);
+}
+
+void SSD1306_I2C::write(uint8_t control, const uint8_t* data, uint32_t len)
+{
+    // The control byte must lead the same transaction, so copy through a
+    // buffer, one page width at a time
+    uint8_t buffer[129];
+    buffer[0] = control;
+
+    while (len > 0)
+    {
+        uint32_t chunk = MIN(len, sizeof(buffer) - 1);
+        memcpy(&buffer[1], data, chunk);
+        i2c_write_blocking(_I2C, _ADDRESS, buffer, chunk + 1, false);
+        data += chunk;
+        len -= chunk;
+    }
+}
@@ -0,0 +1,30 @@
+// Copyright 2021 Dominic Houghton. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// I2C bus for the SSD1306 driver, for the common I2C OLED modules
+
+#ifndef SSD1306_I2C_H
+#define SSD1306_I2C_H
+
+#include "hardware/i2c.h"
+#include "ssd1306.hpp"
+
+class SSD1306_I2C : public SSD1306_Bus {
+    public:
+        SSD1306_I2C(i2c_inst_t* i2cport, uint8_t sda, uint8_t scl, uint8_t address=0x3C, uint32_t baudrate=400*1000);
+
+        void write_commands(const uint8_t* commands, uint32_t len);
+        void write_data(const uint8_t* data, uint32_t len);
+
+    private:
+        void write(uint8_t control, const uint8_t* data, uint32_t len);
+
+        i2c_inst_t* _I2C;
+        uint8_t     _ADDRESS;
+
+        const uint8_t CONTROL_COMMAND = 0x00;
+        const uint8_t CONTROL_DATA    = 0x40;
+};
+
+#endif
@@ -0,0 +1,64 @@
+// Copyright 2021 Dominic Houghton. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Glyph throughput of FBConsole through the I_Framebuffer virtual interface,
+// and statically dispatched to the same inline mock framebuffer. The code size
+// of each is reported by the dispatch_size test.
+
+#include <chrono>
+#include <stdio.h>
+
+#include "check.hpp"
+#include "FBConsole.hpp"
+#include "mock_framebuffer.hpp"
+#include "gamefont.hpp"
+
+static const uint32_t CHARS = 1000000;
+
+// Log-like output: short lines of mixed characters, scrolling continuously
+static char text(uint32_t i)
+{
+    return ((i % 61) == 60) ? '\n' : (char)(0x20 + ((i * 7) % 95));
+}
+
+template <class FB>
+static double run(FB* framebuffer)
+{
+    FBConsole<uint16_t, FB> console(framebuffer, (uint8_t*)&font);
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < CHARS; i++)
+        console.put_char(text(i));
+    auto end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double>(end - start).count();
+}
+
+int main()
+{
+    MockFramebuffer* virtual_mock = new MockFramebuffer();
+    MockFramebuffer* static_mock = new MockFramebuffer();
+
+    // Alternate the two, and keep the best of several runs of each
+    double virtual_s = 0, static_s = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        double v = run<I_Framebuffer<uint16_t>>(virtual_mock);
+        double s = run<MockFramebuffer>(static_mock);
+        virtual_s = ((i == 0) || (v < virtual_s)) ? v : virtual_s;
+        static_s = ((i == 0) || (s < static_s)) ? s : static_s;
+    }
+
+    printf("virtual: %u chars in %.3f s (%.2f M chars/s)\n", CHARS, virtual_s, CHARS / virtual_s / 1e6);
+    printf("static:  %u chars in %.3f s (%.2f M chars/s)\n", CHARS, static_s, CHARS / static_s / 1e6);
+    printf("static is %.2fx the throughput of virtual\n", virtual_s / static_s);
+
+    // Both must have drawn the same thing
+    CHECK(virtual_mock->hash == static_mock->hash);
+    CHECK(virtual_mock->windows == static_mock->windows);
+
+    delete virtual_mock;
+    delete static_mock;
+    return check_result();
+}
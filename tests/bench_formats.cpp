@@ -0,0 +1,111 @@
+// Copyright 2021 Dominic Houghton. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Wire bytes and packing cost of each ILI9341 wire format, for the blocks the
+// console actually sends for log-like output. RGB565 is sent as it is;
+// RGB666 is packed in strips by ili9341_write_pixels. Packing is
+// timed on the host, so compare the formats rather than the absolute times.
+
+#include <chrono>
+#include <stdio.h>
+#include <vector>
+
+#include "check.hpp"
+#include "FBConsole.hpp"
+#include "gamefont.hpp"
+#include "ili9341_bus.hpp"
+
+static const uint32_t CHARS = 100000;
+static const double SPI_HZ = 62.5 * 1000 * 1000;    // Fastest RP2040 SPI clock
+
+// Keeps every block the console sends
+class CaptureFramebuffer : public I_Framebuffer<uint16_t> {
+    public:
+        uint16_t get_color(uint8_t r, uint8_t g, uint8_t b) { return rgb565_swap(rgb565(r, g, b)); }
+        void get_dimensions(uint16_t* width, uint16_t* height) { *width = 320; *height = 240; }
+
+        void plot_block(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t* pixeldata, uint32_t len)
+        {
+            blocks.push_back(len);
+            pixels.insert(pixels.end(), pixeldata, pixeldata + len);
+        }
+
+        void scroll_vertical(uint16_t lines) {}
+
+        std::vector<uint32_t> blocks;
+        std::vector<uint16_t> pixels;
+};
+
+// Counts the packed bytes, and sums a couple from each strip so the packing
+// can't be optimised away
+class CountingBus final : public ILI9341_Bus {
+    public:
+        CountingBus() : bytes(0), checksum(0) {}
+
+        void begin_data(bool frames16) {}
+        void write16(const uint16_t* data, uint32_t len) {}
+        void end_data() {}
+        bool start_async(const void* data, uint32_t count, bool frames16) { return false; }
+
+        void write8(const uint8_t* data, uint32_t len)
+        {
+            checksum += data[0] + data[len - 1];
+            bytes += len;
+        }
+
+        uint64_t bytes;
+        uint32_t checksum;
+};
+
+// Packs every block to RGB666 in strips, returning the bytes produced
+static uint64_t pack_all(CaptureFramebuffer& capture, uint32_t* checksum)
+{
+    CountingBus bus;
+    const uint16_t* pixel = capture.pixels.data();
+
+    for (uint32_t len : capture.blocks)
+    {
+        ili9341_write_pixels(&bus, pixel, len, false, true, false);
+        pixel += len;
+    }
+    *checksum += bus.checksum;
+    return bus.bytes;
+}
+
+int main()
+{
+    CaptureFramebuffer capture;
+    FBConsole<uint16_t> console(&capture, (uint8_t*)&font);
+    for (uint32_t i = 0; i < CHARS; i++)
+        console.put_char(((i % 61) == 60) ? '\n' : (char)(0x20 + ((i * 7) % 95)));
+
+    uint64_t pixels = capture.pixels.size();
+    uint64_t rgb565_bytes = pixels * 2;
+
+    // Keep the best of several runs
+    uint32_t checksum = 0;
+    uint64_t rgb666_bytes = 0;
+    double pack_s = 0;
+    for (int i = 0; i < 5; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        rgb666_bytes = pack_all(capture, &checksum);
+        double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        pack_s = ((i == 0) || (s < pack_s)) ? s : pack_s;
+    }
+
+    printf("%u chars: %llu blocks, %llu pixels\n", CHARS,
+           (unsigned long long)capture.blocks.size(), (unsigned long long)pixels);
+    printf("RGB565: %llu bytes, no packing, %.1f ms at %.1f MHz SPI\n",
+           (unsigned long long)rgb565_bytes, rgb565_bytes * 8 / SPI_HZ * 1000, SPI_HZ / 1e6);
+    printf("RGB666: %llu bytes (+%.0f%%), packing %.2f ns/pixel, %.1f ms at %.1f MHz SPI\n",
+           (unsigned long long)rgb666_bytes, (rgb666_bytes - rgb565_bytes) * 100.0 / rgb565_bytes,
+           pack_s * 1e9 / pixels, rgb666_bytes * 8 / SPI_HZ * 1000, SPI_HZ / 1e6);
+    printf("(checksum %u)\n", checksum);
+
+    CHECK(pixels > 0);
+    CHECK(rgb666_bytes * 2 == rgb565_bytes * 3);
+
+    return check_result();
+}
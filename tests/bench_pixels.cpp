@@ -0,0 +1,138 @@
+// Copyright 2021 Dominic Houghton. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Throughput of the ILI9341 pixel write path in native endian mode (16-bit
+// frames) and byte-swapped mode (8-bit frames), for the blocks the console
+// actually sends for log-like output. The bus hashes every byte in wire
+// order, so both modes are also checked to send identical bytes. Times are
+// taken on the host, so compare the modes rather than the absolute times;
+// on the Pico the difference is in the number of FIFO writes.
+
+#include <chrono>
+#include <stdio.h>
+#include <vector>
+
+#include "check.hpp"
+#include "FBConsole.hpp"
+#include "gamefont.hpp"
+#include "ili9341_bus.hpp"
+
+static const uint32_t CHARS = 100000;
+
+// Keeps every block the console sends, in native or byte-swapped colours
+class CaptureFramebuffer : public I_Framebuffer<uint16_t> {
+    public:
+        CaptureFramebuffer(bool native) : native(native) {}
+
+        uint16_t get_color(uint8_t r, uint8_t g, uint8_t b)
+        {
+            return native ? rgb565(r, g, b) : rgb565_swap(rgb565(r, g, b));
+        }
+        void get_dimensions(uint16_t* width, uint16_t* height) { *width = 320; *height = 240; }
+
+        void plot_block(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t* pixeldata, uint32_t len)
+        {
+            blocks.push_back(len);
+            pixels.insert(pixels.end(), pixeldata, pixeldata + len);
+        }
+
+        void scroll_vertical(uint16_t lines) {}
+
+        bool native;
+        std::vector<uint32_t> blocks;
+        std::vector<uint16_t> pixels;
+};
+
+// Hashes the bytes in the order the SPI would shift them out, and counts the
+// frames written to the FIFO
+class HashBus final : public ILI9341_Bus {
+    public:
+        HashBus() : hash(2166136261u), frames(0) {}
+
+        void begin_data(bool frames16) {}
+        void end_data() {}
+        bool start_async(const void* data, uint32_t count, bool frames16) { return false; }
+
+        void write8(const uint8_t* data, uint32_t len)
+        {
+            for (uint32_t i = 0; i < len; i++)
+                add(data[i]);
+            frames += len;
+        }
+
+        void write16(const uint16_t* data, uint32_t len)
+        {
+            for (uint32_t i = 0; i < len; i++)
+            {
+                add(data[i] >> 8);
+                add(data[i] & 0xFF);
+            }
+            frames += len;
+        }
+
+        uint32_t hash;
+        uint64_t frames;
+
+    private:
+        inline void add(uint8_t byte) { hash = (hash ^ byte) * 16777619u; }
+};
+
+// Sends every captured block, keeping the best time of several runs
+static double send_all(CaptureFramebuffer& capture, HashBus* result)
+{
+    double best = 0;
+    for (int run = 0; run < 5; run++)
+    {
+        HashBus bus;
+        auto start = std::chrono::steady_clock::now();
+        const uint16_t* pixel = capture.pixels.data();
+        for (uint32_t len : capture.blocks)
+        {
+            ili9341_write_pixels(&bus, pixel, len, capture.native, false, false);
+            pixel += len;
+        }
+        double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = ((run == 0) || (s < best)) ? s : best;
+        *result = bus;
+    }
+    return best;
+}
+
+static void render(CaptureFramebuffer& capture)
+{
+    FBConsole<uint16_t> console(&capture, (uint8_t*)&font);
+    for (uint32_t i = 0; i < CHARS; i++)
+        console.put_char(((i % 61) == 60) ? '\n' : (char)(0x20 + ((i * 7) % 95)));
+}
+
+int main()
+{
+    CaptureFramebuffer native(true);
+    CaptureFramebuffer swapped(false);
+    render(native);
+    render(swapped);
+
+    HashBus native_bus;
+    HashBus swapped_bus;
+    double native_s = send_all(native, &native_bus);
+    double swapped_s = send_all(swapped, &swapped_bus);
+
+    uint64_t pixels = native.pixels.size();
+    printf("%u chars: %llu blocks, %llu pixels\n", CHARS,
+           (unsigned long long)native.blocks.size(), (unsigned long long)pixels);
+    printf("native:  %.2f ns/pixel, %.2f Mpixel/s, %llu FIFO writes (hash %08x)\n",
+           native_s * 1e9 / pixels, pixels / native_s / 1e6,
+           (unsigned long long)native_bus.frames, native_bus.hash);
+    printf("swapped: %.2f ns/pixel, %.2f Mpixel/s, %llu FIFO writes (hash %08x)\n",
+           swapped_s * 1e9 / pixels, pixels / swapped_s / 1e6,
+           (unsigned long long)swapped_bus.frames, swapped_bus.hash);
+
+    CHECK(pixels > 0);
+    CHECK(swapped.pixels.size() == pixels);
+    CHECK(native_bus.hash == swapped_bus.hash);
+    CHECK(native_bus.frames == pixels);
+    CHECK(swapped_bus.frames == pixels * 2);
+
+    return check_result();
+}
@@ -0,0 +1,11 @@
+// Copyright 2021 Dominic Houghton. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// The console statically dispatched to the inline mock, on its own so its code
+// size can be measured
+
+#include "FBConsole_impl.hpp"
+#include "mock_framebuffer.hpp"
+
+template class FBConsole<uint16_t, MockFramebuffer>;
@@ -0,0 +1,9 @@
+// Copyright 2021 Dominic Houghton. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// The virtually dispatched console, on its own so its code size can be measured
+
+#include "FBConsole_impl.hpp"
+
+template class FBConsole<uint16_t>;
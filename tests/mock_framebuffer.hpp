@@ -0,0 +1,50 @@
+// Copyright 2021 Dominic Houghton. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// RGB565 framebuffer with every method defined inline, standing in for a
+// display driver whose window setup the compiler can inline. Rather than
+// keeping the pixels, it hashes the stream of windows and pixel data it would
+// send, so two consoles can be checked for drawing the same thing.
+
+#ifndef MOCK_FRAMEBUFFER_H
+#define MOCK_FRAMEBUFFER_H
+
+#include "I_Framebuffer.hpp"
+#include "rgb565.hpp"
+
+class MockFramebuffer final : public I_Framebuffer<uint16_t> {
+    public:
+        static const uint16_t WIDTH = 320;
+        static const uint16_t HEIGHT = 240;
+
+        uint16_t get_color(uint8_t r, uint8_t g, uint8_t b)
+        {
+            return rgb565(r, g, b);
+        }
+
+        void get_dimensions(uint16_t* width, uint16_t* height)
+        {
+            *width = WIDTH;
+            *height = HEIGHT;
+        }
+
+        void plot_block(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t* pixeldata, uint32_t len)
+        {
+            windows++;
+            hash = (hash * 31) + ((x0 << 16) | y0);
+            hash = (hash * 31) + ((x1 << 16) | y1);
+            for (uint32_t i = 0; i < len; i++)
+                hash = (hash * 31) + pixeldata[i];
+        }
+
+        void scroll_vertical(uint16_t lines)
+        {
+            hash = (hash * 31) + lines;
+        }
+
+        uint32_t hash = 0;
+        uint32_t windows = 0;
+};
+
+#endif
@@ -0,0 +1,81 @@
+// Copyright 2021 Dominic Houghton. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Tests the clock calibration search against a simulated SPI bus
+
+#include "check.hpp"
+#include "fbcalibrate.hpp"
+
+// Divides a 125MHz peripheral clock like the RP2040 SPI (prescale 2, then the
+// smallest divider not exceeding the request), and corrupts data above a threshold
+class VirtualBus : public FBCalibrate_Bus {
+    public:
+        VirtualBus(uint32_t error_above) { _ERROR_ABOVE = error_above; }
+
+        uint32_t set_baudrate(uint32_t baudrate)
+        {
+            uint32_t divider = 1;
+            while ((divider < 256) && ((CLOCK / (2 * divider)) > baudrate))
+                divider++;
+            rate = CLOCK / (2 * divider);
+            return rate;
+        }
+
+        bool write_readback()
+        {
+            tried[tries++] = rate;
+            return rate <= _ERROR_ABOVE;
+        }
+
+        static const uint32_t CLOCK = 125*1000*1000;
+
+        uint32_t rate = 0;
+        uint32_t tried[64];
+        int tries = 0;
+
+    private:
+        uint32_t _ERROR_ABOVE;
+};
+
+int main()
+{
+    // The divider gives 8.93, 10.42, 12.5, 15.63, 20.83, 31.25 and 62.5MHz in
+    // this range. Errors start above 25MHz.
+    VirtualBus bus(25*1000*1000);
+    uint32_t baudrate = fbcalibrate(&bus, 10*1000*1000, 63*1000*1000, 1*1000*1000, 10);
+
+    // Each actual rate is tried once, in rising order, stopping at the first failure
+    CHECK(bus.tries == 6);
+    for (int i = 1; i < bus.tries; i++)
+        CHECK(bus.tried[i] > bus.tried[i - 1]);
+    CHECK(bus.tried[0] == 125000000 / 14);
+    CHECK(bus.tried[4] == 125000000 / 6);
+    CHECK(bus.tried[5] == 125000000 / 4);
+
+    // The fastest clean rate was 20.83MHz; less 10% is 18.75MHz, which the
+    // divider rounds down to 15.63MHz
+    CHECK(baudrate == 125000000 / 8);
+    CHECK(bus.rate == baudrate);
+
+    // No margin leaves the fastest clean rate
+    VirtualBus exact(25*1000*1000);
+    CHECK(fbcalibrate(&exact, 10*1000*1000, 63*1000*1000, 1*1000*1000, 0) == 125000000 / 6);
+
+    // Everything clean runs to the top of the range
+    VirtualBus clean(0xFFFFFFFF);
+    CHECK(fbcalibrate(&clean, 10*1000*1000, 63*1000*1000, 1*1000*1000, 0) == 125000000 / 2);
+    CHECK(clean.tries == 7);
+
+    // A bus that fails at the lowest rate (e.g. no MISO) gives 0, having tried only that
+    VirtualBus dead(0);
+    CHECK(fbcalibrate(&dead, 10*1000*1000, 63*1000*1000, 1*1000*1000, 10) == 0);
+    CHECK(dead.tries == 1);
+
+    // A range at the top of uint32_t ends rather than wrapping
+    VirtualBus top(0xFFFFFFFF);
+    fbcalibrate(&top, 0xFFFFFF00, 0xFFFFFFFF, 0x80, 0);
+    CHECK(top.tries <= 3);
+
+    return check_result();
+}
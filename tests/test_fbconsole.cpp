@@ -0,0 +1,214 @@
+// Copyright 2021 Dominic Houghton. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Tests the console's colour palette: colours are reused once no cell needs
+// them, and refused when every entry is in use, rather than recolouring text.
+// Also tests the text rows reported to the framebuffer, and that consoles too
+// large for the mirror stream aren't mirrored.
+
+#include <string.h>
+
+#include "check.hpp"
+#include "FBConsole.hpp"
+
+// Keeps its pixels, so the test can see what the console drew
+class PixelFramebuffer : public I_Framebuffer<uint16_t> {
+    public:
+        static const uint16_t WIDTH = 64;
+        static const uint16_t HEIGHT = 24;
+
+        uint16_t get_color(uint8_t r, uint8_t g, uint8_t b) { return (r << 8) | g; }
+        void get_dimensions(uint16_t* width, uint16_t* height) { *width = WIDTH; *height = HEIGHT; }
+
+        void plot_block(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t* pixeldata, uint32_t len)
+        {
+            uint16_t width = x1 - x0 + 1;
+            for (uint32_t i = 0; i < len; i++)
+                pixels[y0 + (i / width)][x0 + (i % width)] = pixeldata[i];
+        }
+
+        void scroll_vertical(uint16_t pixels) {}
+
+        void set_text_rows(int32_t top, int32_t bottom)
+        {
+            text_top = top;
+            text_bottom = bottom;
+            reports++;
+        }
+
+        // Colour of a cell's top left pixel
+        uint16_t cell(uint16_t x, uint16_t y) { return pixels[y * 8][x * 8]; }
+
+        uint16_t pixels[HEIGHT][WIDTH];
+        int32_t text_top = -2;
+        int32_t text_bottom = -2;
+        int reports = 0;
+};
+
+// Space is all background, '#' all foreground
+static uint8_t font[96 * 8];
+
+static void test_text_rows()
+{
+    PixelFramebuffer display;
+    FBConsole<uint16_t> console(&display, font);
+
+    // Nothing drawn yet
+    console.report_text_rows();
+    CHECK(display.text_top == -1);
+    CHECK(display.text_bottom == -1);
+
+    // Only reported again once the cells change
+    console.report_text_rows();
+    CHECK(display.reports == 1);
+
+    // Spaces on black aren't text
+    console.put_string("   ");
+    console.report_text_rows();
+    CHECK(display.text_top == -1);
+
+    // Text on the second row, in pixel rows
+    console.put_string("\n #");
+    console.report_text_rows();
+    CHECK(display.text_top == 8);
+    CHECK(display.text_bottom == 15);
+
+    // A coloured background counts even without a glyph
+    console.set_background(0x1234);
+    console.put_string("\n ");
+    console.set_background(0x0000);
+    console.report_text_rows();
+    CHECK(display.text_top == 8);
+    CHECK(display.text_bottom == 23);
+
+    // Scrolling moves the text up with it
+    console.put_string("\n");
+    console.report_text_rows();
+    CHECK(display.text_top == 0);
+    CHECK(display.text_bottom == 15);
+
+    // Overwriting the text with spaces leaves only the coloured cell
+    console.set_location(1, 0);
+    console.put_char(' ');
+    console.report_text_rows();
+    CHECK(display.text_top == 8);
+    CHECK(display.text_bottom == 15);
+
+    console.clear();
+    console.report_text_rows();
+    CHECK(display.text_top == -1);
+}
+
+// Draws nothing; only its size matters
+class SizedFramebuffer : public I_Framebuffer<uint16_t> {
+    public:
+        SizedFramebuffer(uint16_t width, uint16_t height) { _WIDTH = width; _HEIGHT = height; }
+
+        uint16_t get_color(uint8_t r, uint8_t g, uint8_t b) { return (r << 8) | g; }
+        void get_dimensions(uint16_t* width, uint16_t* height) { *width = _WIDTH; *height = _HEIGHT; }
+        void plot_block(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t* pixeldata, uint32_t len) {}
+        void scroll_vertical(uint16_t pixels) {}
+
+    private:
+        uint16_t _WIDTH;
+        uint16_t _HEIGHT;
+};
+
+static uint32_t mirror_bytes;
+
+static void count_chars(const char* buf, int len)
+{
+    mirror_bytes += len;
+}
+
+static void test_mirror_limits()
+{
+    FBMirror mirror(count_chars, FBMIRROR_RGB565);
+
+    // 255 x 255 cells is the most the stream can address
+    SizedFramebuffer largest(255 * 8, 255 * 8);
+    FBConsole<uint16_t> fits(&largest, font);
+    CHECK(fits.set_mirror(&mirror));
+    fits.put_char('#');
+    fits.mirror_flush();
+    CHECK(mirror_bytes > 0);
+    CHECK(fits.set_mirror(0));
+
+    // One cell more either way is refused, and nothing is sent
+    SizedFramebuffer wide(256 * 8, 8);
+    SizedFramebuffer tall(8, 256 * 8);
+    FBConsole<uint16_t> too_wide(&wide, font);
+    FBConsole<uint16_t> too_tall(&tall, font);
+    mirror_bytes = 0;
+    CHECK(!too_wide.set_mirror(&mirror));
+    CHECK(!too_tall.set_mirror(&mirror));
+    too_wide.put_char('#');
+    too_wide.mirror_flush();
+    too_tall.put_char('#');
+    too_tall.mirror_flush();
+    CHECK(mirror_bytes == 0);
+}
+
+int main()
+{
+    memset(&font[('#' - 0x20) * 8], 0xFF, 8);
+    test_text_rows();
+    test_mirror_limits();
+
+    PixelFramebuffer display;
+    FBConsole<uint16_t> console(&display, font);
+    uint16_t width, height;
+    console.get_dimensions(&width, &height);
+    CHECK(width == 8);
+    CHECK(height == 3);
+
+    // White on black takes two entries; fill the other 14 with text in
+    // different colours on the first two rows
+    for (uint16_t i = 0; i < 14; i++)
+    {
+        CHECK(console.set_foreground(0x1000 + i));
+        console.put_char('#');
+    }
+    CHECK(console.set_foreground(0xFFFF));
+    console.put_char('#');
+
+    // Every entry is in use, so a new colour is refused and nothing changes
+    CHECK(!console.set_foreground(0x2000));
+    CHECK(!console.set_background(0x2000));
+    console.put_char('#');
+    console.put_char(' ');
+    for (uint16_t i = 0; i < 14; i++)
+        CHECK(display.cell(i % 8, i / 8) == 0x1000 + i);
+    CHECK(display.cell(14 % 8, 14 / 8) == 0xFFFF);
+    CHECK(display.cell(15 % 8, 15 / 8) == 0xFFFF);
+    CHECK(display.cell(16 % 8, 16 / 8) == 0x0000);
+
+    // Overwrite the first colour's only cell; its entry is free again, and
+    // taking it doesn't disturb the foreground or any other text
+    console.set_location(0, 0);
+    console.put_char(' ');
+    CHECK(console.set_background(0x3000));
+    console.set_location(3, 2);
+    console.put_char('#');
+    console.put_char(' ');
+    CHECK(display.cell(3, 2) == 0xFFFF);
+    CHECK(display.cell(4, 2) == 0x3000);
+    for (uint16_t i = 1; i < 14; i++)
+        CHECK(display.cell(i % 8, i / 8) == 0x1000 + i);
+
+    // A repaint draws the same colours from the cell state
+    console.repaint();
+    CHECK(display.cell(0, 0) == 0x0000);
+    CHECK(display.cell(3, 2) == 0xFFFF);
+    CHECK(display.cell(4, 2) == 0x3000);
+    for (uint16_t i = 1; i < 14; i++)
+        CHECK(display.cell(i % 8, i / 8) == 0x1000 + i);
+
+    // Clearing frees everything but the current colours
+    console.clear();
+    for (uint16_t i = 0; i < 14; i++)
+        CHECK(console.set_foreground(0x4000 + i));
+
+    return check_result();
+}
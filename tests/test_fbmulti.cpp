@@ -0,0 +1,93 @@
+// Copyright 2021 Dominic Houghton. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Tests that FBMulti keeps the rows of a taller display below the common
+// area black as it scrolls
+
+#include <string.h>
+
+#include "check.hpp"
+#include "FBMulti.hpp"
+
+// Scrolls like a display with a hardware scroll offset: rows leaving the top
+// come back in at the bottom
+class RingFramebuffer : public I_Framebuffer<uint16_t> {
+    public:
+        RingFramebuffer(uint16_t width, uint16_t height)
+        {
+            _WIDTH = width;
+            _HEIGHT = height;
+            _SCROLL = 0;
+            _PIXELS = new uint16_t[width * height];
+            for (uint32_t i = 0; i < (uint32_t)(width * height); i++)
+                _PIXELS[i] = 0xAAAA;
+        }
+        ~RingFramebuffer() { delete[] _PIXELS; }
+
+        uint16_t get_color(uint8_t r, uint8_t g, uint8_t b) { return (r << 8) | (g << 4) | b; }
+        void get_dimensions(uint16_t* width, uint16_t* height) { *width = _WIDTH; *height = _HEIGHT; }
+
+        void plot_block(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t* pixeldata, uint32_t len)
+        {
+            uint16_t width = x1 - x0 + 1;
+            for (uint32_t i = 0; i < len; i++)
+                *pixel(x0 + (i % width), y0 + (i / width)) = pixeldata[i];
+        }
+
+        void scroll_vertical(uint16_t pixels) { _SCROLL = (_SCROLL + pixels) % _HEIGHT; }
+
+        uint16_t* pixel(uint16_t x, uint16_t y) { return &_PIXELS[(((y + _SCROLL) % _HEIGHT) * _WIDTH) + x]; }
+
+    private:
+        uint16_t _WIDTH;
+        uint16_t _HEIGHT;
+        uint16_t _SCROLL;
+        uint16_t* _PIXELS;
+};
+
+int main()
+{
+    RingFramebuffer small(16, 8);
+    RingFramebuffer tall(16, 12);
+    I_Framebuffer<uint16_t>* backends[] = { &small, &tall };
+    FBMulti<uint16_t> multi(backends, 2);
+
+    uint16_t width, height;
+    multi.get_dimensions(&width, &height);
+    CHECK(width == 16);
+    CHECK(height == 8);
+
+    // The area below the console starts black
+    for (uint16_t y = 8; y < 12; y++)
+        CHECK(*tall.pixel(0, y) == 0);
+
+    // Fill the console, then scroll it a few times, as FBConsole would
+    uint16_t row[16];
+    for (uint16_t y = 0; y < 8; y++)
+    {
+        for (int x = 0; x < 16; x++)
+            row[x] = 1 + y;
+        multi.plot_block(0, y, 15, y, row, 16);
+    }
+    for (int i = 0; i < 5; i++)
+    {
+        multi.scroll_vertical(3);
+        for (uint16_t y = 5; y < 8; y++)
+        {
+            for (int x = 0; x < 16; x++)
+                row[x] = 100 + i;
+            multi.plot_block(0, y, 15, y, row, 16);
+        }
+
+        // Both displays show the same console, and nothing below it
+        for (uint16_t y = 0; y < 8; y++)
+            for (uint16_t x = 0; x < 16; x++)
+                CHECK(*small.pixel(x, y) == *tall.pixel(x, y));
+        for (uint16_t y = 8; y < 12; y++)
+            for (uint16_t x = 0; x < 16; x++)
+                CHECK(*tall.pixel(x, y) == 0);
+    }
+
+    return check_result();
+}
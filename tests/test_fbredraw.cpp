@@ -0,0 +1,162 @@
+// Copyright 2021 Dominic Houghton. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Tests the console's minimal redraw: after random overwrites, at each scale,
+// the screen must match a full redraw of the same cells, while sending fewer
+// pixels than drawing every cell whole. Also checks the pixels drawn through
+// plot_glyph are counted.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.hpp"
+#include "FBConsole.hpp"
+#include "gamefont.hpp"
+
+static const uint16_t WIDTH = 96;
+static const uint16_t HEIGHT = 72;
+static const uint32_t WRITES = 5000;
+
+// Keeps its pixels, and counts those plotted. With glyphs set, it draws
+// glyphs itself, as a packed-pixel driver would.
+class PixelFramebuffer : public I_Framebuffer<uint16_t> {
+    public:
+        PixelFramebuffer(bool glyphs = false) : glyphs(glyphs), plotted(0)
+        {
+            // Anything the console fails to draw shows up against this
+            for (int y = 0; y < HEIGHT; y++)
+                for (int x = 0; x < WIDTH; x++)
+                    pixels[y][x] = 0xDEAD;
+        }
+
+        uint16_t get_color(uint8_t r, uint8_t g, uint8_t b) { return (r << 8) | g; }
+        void get_dimensions(uint16_t* width, uint16_t* height) { *width = WIDTH; *height = HEIGHT; }
+
+        void plot_block(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t* pixeldata, uint32_t len)
+        {
+            uint16_t width = x1 - x0 + 1;
+            CHECK(len == (uint32_t)width * (y1 - y0 + 1));
+            for (uint32_t i = 0; i < len; i++)
+                pixels[y0 + (i / width)][x0 + (i % width)] = pixeldata[i];
+            plotted += len;
+        }
+
+        bool plot_glyph(uint16_t x, uint16_t y, const uint8_t* glyph, uint8_t scale, uint16_t foreground, uint16_t background)
+        {
+            if (!glyphs)
+                return false;
+
+            for (int py = 0; py < 8 * scale; py++)
+                for (int px = 0; px < 8 * scale; px++)
+                    pixels[y + py][x + px] = ((glyph[py / scale] >> (7 - (px / scale))) & 1) ? foreground : background;
+            plotted += 64 * scale * scale;
+            return true;
+        }
+
+        void scroll_vertical(uint16_t lines) {}
+
+        bool glyphs;
+        uint64_t plotted;
+        uint16_t pixels[HEIGHT][WIDTH];
+};
+
+static const uint16_t COLORS[][3] = {
+    { 0xFF, 0xFF, 0xFF },
+    { 0x00, 0x00, 0x00 },
+    { 0xFF, 0x00, 0x00 },
+    { 0x00, 0x80, 0xFF },
+};
+
+// Paints the screen, then overwrites random cells with random characters,
+// mostly white on black. Returns the pixels sent and saved by the overwrites.
+static void overwrite(FBConsole<uint16_t>& console, PixelFramebuffer& display, uint32_t* sent, uint32_t* saved)
+{
+    uint16_t columns, rows;
+    console.get_dimensions(&columns, &rows);
+    console.repaint();
+    uint32_t painted, unsent;
+    console.get_stats(&painted, &unsent);
+    display.plotted = 0;
+
+    for (uint32_t i = 0; i < WRITES; i++)
+    {
+        // One in eight is in other colours, which redraws the whole cell
+        const uint16_t* fg = COLORS[0];
+        const uint16_t* bg = COLORS[1];
+        if ((rand() % 8) == 0)
+        {
+            fg = COLORS[rand() % 4];
+            bg = COLORS[rand() % 4];
+        }
+        console.set_foreground(display.get_color(fg[0], fg[1], fg[2]));
+        console.set_background(display.get_color(bg[0], bg[1], bg[2]));
+
+        // Anywhere but the last cell, which would scroll; the characters
+        // include the invalid glyph
+        uint16_t x, y;
+        do {
+            x = rand() % columns;
+            y = rand() % rows;
+        } while ((x == columns - 1) && (y == rows - 1));
+        console.set_location(x, y);
+        console.put_char((char)(0x20 + (rand() % 97)));
+    }
+
+    console.get_stats(sent, saved);
+    *sent -= painted;
+    *saved -= unsent;
+}
+
+static void test_scale(uint8_t scale)
+{
+    PixelFramebuffer display;
+    FBConsole<uint16_t> console(&display, (uint8_t*)&font, scale);
+    uint32_t sent, saved;
+    overwrite(console, display, &sent, &saved);
+
+    // Everything not sent was saved
+    uint64_t full = (uint64_t)WRITES * 64 * scale * scale;
+    CHECK(sent == display.plotted);
+    CHECK((uint64_t)sent + saved == full);
+
+    // Repainting every cell whole onto a fresh framebuffer gives the reference
+    PixelFramebuffer reference;
+    console.bind(&reference);
+    CHECK(memcmp(display.pixels, reference.pixels, sizeof(display.pixels)) == 0);
+
+    // Mostly same-colour overwrites of the 8x8 font leave well over a quarter unsent
+    CHECK(display.plotted * 4 < full * 3);
+    printf("scale %u: %llu of %llu pixels sent (%.0f%% saved)\n", scale,
+           (unsigned long long)display.plotted, (unsigned long long)full,
+           100.0 - (display.plotted * 100.0 / full));
+}
+
+// Cells drawn by the framebuffer itself are counted as sent
+static void test_glyph_stats(uint8_t scale)
+{
+    PixelFramebuffer display(true);
+    FBConsole<uint16_t> console(&display, (uint8_t*)&font, scale);
+    uint32_t sent, saved;
+    overwrite(console, display, &sent, &saved);
+    CHECK(sent > 0);
+    CHECK(sent == display.plotted);
+    CHECK((uint64_t)sent + saved == (uint64_t)WRITES * 64 * scale * scale);
+
+    PixelFramebuffer reference;
+    console.bind(&reference);
+    CHECK(memcmp(display.pixels, reference.pixels, sizeof(display.pixels)) == 0);
+}
+
+int main()
+{
+    srand(1);
+    for (uint8_t scale = 1; scale <= 3; scale++)
+    {
+        test_scale(scale);
+        test_glyph_stats(scale);
+    }
+
+    return check_result();
+}
@@ -0,0 +1,118 @@
+// Copyright 2021 Dominic Houghton. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Tests switching between virtual terminals: terminals that aren't active
+// never touch the framebuffer, and switching repaints the whole screen from
+// the new terminal's cells
+
+#include <string.h>
+
+#include "check.hpp"
+#include "FBTerminals.hpp"
+
+// Keeps its pixels, and counts the calls that draw them
+class PixelFramebuffer : public I_Framebuffer<uint16_t> {
+    public:
+        static const uint16_t WIDTH = 32;
+        static const uint16_t HEIGHT = 16;
+
+        uint16_t get_color(uint8_t r, uint8_t g, uint8_t b) { return (r << 8) | g; }
+        void get_dimensions(uint16_t* width, uint16_t* height) { *width = WIDTH; *height = HEIGHT; }
+
+        void plot_block(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t* pixeldata, uint32_t len)
+        {
+            uint16_t width = x1 - x0 + 1;
+            for (uint32_t i = 0; i < len; i++)
+                pixels[y0 + (i / width)][x0 + (i % width)] = pixeldata[i];
+            calls++;
+        }
+
+        void scroll_vertical(uint16_t lines) { calls++; }
+
+        // True if every pixel of the cell is color
+        bool cell_is(uint16_t x, uint16_t y, uint16_t color)
+        {
+            for (int py = 0; py < 8; py++)
+                for (int px = 0; px < 8; px++)
+                    if (pixels[(y * 8) + py][(x * 8) + px] != color)
+                        return false;
+            return true;
+        }
+
+        uint16_t pixels[HEIGHT][WIDTH];
+        int calls = 0;
+};
+
+static const uint16_t WHITE = 0xFFFF;
+static const uint16_t BLACK = 0x0000;
+static const uint16_t GARBAGE = 0x5A5A;
+
+// Space is all background, '#' all foreground
+static uint8_t font[96 * 8];
+
+int main()
+{
+    memset(&font[('#' - 0x20) * 8], 0xFF, 8);
+
+    PixelFramebuffer display;
+    FBTerminals<uint16_t> terminals(&display, font, 3);
+    CHECK(terminals.get_count() == 3);
+    CHECK(terminals.get_active_index() == 0);
+
+    terminals.get(0)->put_string(" #");
+    CHECK(display.cell_is(1, 0, WHITE));
+
+    // Output to the other terminals, including a clear and a scroll, only
+    // changes their cells
+    int calls = display.calls;
+    FBConsole<uint16_t>* second = terminals.get(1);
+    second->put_string("#\n\n\n#");
+    second->clear();
+    second->put_string("#");
+    second->set_location(2, 1);
+    second->put_string("#");
+    second->repaint();
+    second->report_text_rows();
+    terminals.get(2)->put_string("\n\n\n\n\n");
+    CHECK(display.calls == calls);
+    CHECK(display.cell_is(0, 0, BLACK));
+    CHECK(display.cell_is(1, 0, WHITE));
+
+    // Switching paints every pixel from the second terminal's cells
+    for (int y = 0; y < PixelFramebuffer::HEIGHT; y++)
+        for (int x = 0; x < PixelFramebuffer::WIDTH; x++)
+            display.pixels[y][x] = GARBAGE;
+    terminals.switch_to(1);
+    CHECK(terminals.get_active() == second);
+    for (uint16_t y = 0; y < 2; y++)
+        for (uint16_t x = 0; x < 4; x++)
+        {
+            bool text = ((x == 0) && (y == 0)) || ((x == 2) && (y == 1));
+            CHECK(display.cell_is(x, y, text ? WHITE : BLACK));
+        }
+
+    // The first terminal's output now waits for the next switch
+    calls = display.calls;
+    terminals.get(0)->put_string("#");
+    CHECK(display.calls == calls);
+
+    // Switching to the active terminal, or one that doesn't exist, does nothing
+    terminals.switch_to(1);
+    terminals.switch_to(3);
+    CHECK(display.calls == calls);
+    CHECK(terminals.get_active_index() == 1);
+
+    // Back to the first, with its new output
+    terminals.switch_to(0);
+    CHECK(display.cell_is(0, 0, BLACK));
+    CHECK(display.cell_is(1, 0, WHITE));
+    CHECK(display.cell_is(2, 0, WHITE));
+    CHECK(display.cell_is(2, 1, BLACK));
+
+    // The active terminal draws again
+    terminals.get_active()->put_string("#");
+    CHECK(display.cell_is(3, 0, WHITE));
+
+    return check_result();
+}
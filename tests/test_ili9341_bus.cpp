@@ -0,0 +1,158 @@
+// Copyright 2021 Dominic Houghton. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Tests the ILI9341 pixel write path against a recording bus: native pixels
+// sent as 16-bit frames must put the same bytes on the wire as the same
+// pixels byte-swapped and sent as 8-bit data, blocking or by DMA, and in
+// either wire format
+
+#include <stdlib.h>
+#include <vector>
+
+#include "check.hpp"
+#include "ili9341_bus.hpp"
+
+// Records the bytes in the order the SPI would shift them out
+class RecordingBus : public ILI9341_Bus {
+    public:
+        RecordingBus(bool dma) : dma(dma), transactions(0), open(false), frames16(false), async(false) {}
+
+        void begin_data(bool frames)
+        {
+            CHECK(!open);
+            open = true;
+            frames16 = frames;
+            transactions++;
+        }
+
+        void write8(const uint8_t* data, uint32_t len)
+        {
+            CHECK(open);
+            CHECK(!frames16);
+            bytes.insert(bytes.end(), data, data + len);
+        }
+
+        void write16(const uint16_t* data, uint32_t len)
+        {
+            CHECK(open);
+            CHECK(frames16);
+            for (uint32_t i = 0; i < len; i++)
+            {
+                bytes.push_back(data[i] >> 8);
+                bytes.push_back(data[i] & 0xFF);
+            }
+        }
+
+        void end_data()
+        {
+            CHECK(open);
+            open = false;
+        }
+
+        bool start_async(const void* data, uint32_t count, bool frames)
+        {
+            CHECK(open);
+            CHECK(frames == frames16);
+            if (!dma)
+                return false;
+
+            async = true;
+            if (frames)
+                write16((const uint16_t*)data, count);
+            else
+                write8((const uint8_t*)data, count);
+            return true;
+        }
+
+        bool dma;
+        std::vector<uint8_t> bytes;
+        int transactions;
+        bool open;
+        bool frames16;
+        bool async;
+};
+
+static std::vector<uint16_t> random_pixels(uint32_t len)
+{
+    std::vector<uint16_t> pixels(len);
+    for (uint16_t& pixel : pixels)
+        pixel = (uint16_t)rand();
+    return pixels;
+}
+
+static std::vector<uint16_t> swapped(const std::vector<uint16_t>& pixels)
+{
+    std::vector<uint16_t> out(pixels.size());
+    for (size_t i = 0; i < pixels.size(); i++)
+        out[i] = rgb565_swap(pixels[i]);
+    return out;
+}
+
+// Native frames and the swapped byte stream, blocking and by DMA
+static void test_rgb565(uint32_t len, bool async, bool dma)
+{
+    std::vector<uint16_t> pixels = random_pixels(len);
+    std::vector<uint16_t> wire = swapped(pixels);
+
+    RecordingBus native(dma);
+    bool native_running = ili9341_write_pixels(&native, pixels.data(), len, true, false, async);
+    RecordingBus bytes(dma);
+    bool bytes_running = ili9341_write_pixels(&bytes, wire.data(), len, false, false, async);
+
+    CHECK(native.bytes.size() == len * 2);
+    CHECK(native.bytes == bytes.bytes);
+
+    // The first byte on the wire is the high byte of the first pixel
+    CHECK(native.bytes[0] == (pixels[0] >> 8));
+
+    // Each is one transaction, left open only if DMA took it
+    bool running = async && dma;
+    CHECK(native.transactions == 1);
+    CHECK(bytes.transactions == 1);
+    CHECK(native_running == running);
+    CHECK(bytes_running == running);
+    CHECK(native.open == running);
+    CHECK(bytes.open == running);
+    CHECK(native.async == running);
+    CHECK(bytes.async == running);
+}
+
+// Packed RGB666 is the same from either byte order, and in one transaction
+static void test_rgb666(uint32_t len, bool async)
+{
+    std::vector<uint16_t> pixels = random_pixels(len);
+    std::vector<uint16_t> wire = swapped(pixels);
+
+    RecordingBus native(true);
+    CHECK(!ili9341_write_pixels(&native, pixels.data(), len, true, true, async));
+    RecordingBus bytes(true);
+    CHECK(!ili9341_write_pixels(&bytes, wire.data(), len, false, true, async));
+
+    std::vector<uint8_t> expected(len * 3);
+    rgb565_pack_rgb666(pixels.data(), len, expected.data(), false);
+    CHECK(native.bytes == expected);
+    CHECK(bytes.bytes == expected);
+
+    CHECK(native.transactions == 1);
+    CHECK(!native.open);
+    CHECK(!native.async);
+}
+
+int main()
+{
+    srand(1);
+
+    // Lengths either side of a packing strip
+    const uint32_t lengths[] = { 1, 2, 63, 64, 65, 200, 64 * 5 };
+    for (uint32_t len : lengths)
+    {
+        test_rgb565(len, false, true);
+        test_rgb565(len, true, true);
+        test_rgb565(len, true, false);
+        test_rgb666(len, false);
+        test_rgb666(len, true);
+    }
+
+    return check_result();
+}
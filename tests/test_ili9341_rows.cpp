@@ -0,0 +1,85 @@
+// Copyright 2021 Dominic Houghton. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Tests the ILI9341 partial area mapping against a model of the panel: rows
+// are written through the page address, reversed in RAM by MY, and scanned
+// from the scroll start address. The partial area must cover exactly the RAM
+// rows holding the text, at any scroll offset, including when they wrap.
+
+#include "check.hpp"
+#include "ili9341_rows.hpp"
+
+static const uint16_t HEIGHT = 320;
+
+// The logical row shown by each RAM row, as drawing leaves it
+struct Panel {
+    int32_t ram[HEIGHT];
+
+    Panel(uint16_t offset, bool mirrored)
+    {
+        for (uint16_t y = 0; y < HEIGHT; y++)
+        {
+            uint16_t page = (y + offset) % HEIGHT;
+            ram[mirrored ? (HEIGHT - 1 - page) : page] = y;
+        }
+    }
+};
+
+// True if RAM row r is inside the partial area start..end, wrapping
+static bool in_area(uint16_t r, uint16_t start, uint16_t end)
+{
+    if (start <= end)
+        return (r >= start) && (r <= end);
+    return (r >= start) || (r <= end);
+}
+
+static void check_area(int32_t top, int32_t bottom, uint16_t offset, bool mirrored)
+{
+    uint16_t start, end;
+    ili9341_partial_area(top, bottom, HEIGHT, offset, mirrored, &start, &end);
+    CHECK(start < HEIGHT);
+    CHECK(end < HEIGHT);
+
+    Panel panel(offset, mirrored);
+    int failures = 0;
+    for (uint16_t r = 0; r < HEIGHT; r++)
+    {
+        bool text = (panel.ram[r] >= top) && (panel.ram[r] <= bottom);
+        if (in_area(r, start, end) != text)
+            failures++;
+    }
+    CHECK(failures == 0);
+}
+
+int main()
+{
+    for (int mirrored = 0; mirrored < 2; mirrored++)
+    {
+        // Offset 0, with MY set: the top text rows are at the end of RAM
+        uint16_t start, end;
+        ili9341_partial_area(0, 7, HEIGHT, 0, mirrored, &start, &end);
+        CHECK(start == (mirrored ? HEIGHT - 8 : 0));
+        CHECK(end == (mirrored ? HEIGHT - 1 : 7));
+        check_area(0, 7, 0, mirrored);
+        check_area(16, 239, 0, mirrored);
+
+        // A mid-ring offset, as after scrolling
+        check_area(0, 7, 120, mirrored);
+        check_area(40, 199, 120, mirrored);
+        check_area(312, 319, 120, mirrored);
+
+        // Text rows that wrap past the end of RAM
+        check_area(0, 95, 280, mirrored);
+        check_area(200, 300, 160, mirrored);
+
+        // Every offset, for a block of rows and a single row
+        for (uint16_t offset = 0; offset < HEIGHT; offset++)
+        {
+            check_area(8, 63, offset, mirrored);
+            check_area(HEIGHT - 1, HEIGHT - 1, offset, mirrored);
+        }
+    }
+
+    return check_result();
+}
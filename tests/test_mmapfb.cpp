@@ -0,0 +1,82 @@
+// Copyright 2021 Dominic Houghton. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Tests the framebuffer file layout, and that scrolling moves the ring offset
+// rather than the pixels
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "check.hpp"
+#include "mmapfb.hpp"
+
+// Reads logical row y of a framebuffer file the way a viewer would
+static uint16_t* viewer_row(mmapfb_header* header, uint16_t y)
+{
+    uint8_t* pixels = (uint8_t*)header + header->header_size;
+    return (uint16_t*)(pixels + (((y + header->scroll) % header->height) * header->stride));
+}
+
+int main(int argc, char** argv)
+{
+    const char* path = (argc > 1) ? argv[1] : "test_mmapfb.fb";
+    unlink(path);
+
+    MmapFramebuffer<uint16_t> fb(path, 16, 8);
+    CHECK(fb.is_open());
+
+    // The header is written as soon as the file is created
+    FILE* file = fopen(path, "rb");
+    CHECK(file != 0);
+    mmapfb_header header;
+    CHECK(fread(&header, sizeof(header), 1, file) == 1);
+    fclose(file);
+    CHECK(header.magic == MMAPFB_MAGIC);
+    CHECK(header.width == 16);
+    CHECK(header.height == 8);
+    CHECK(header.format == MMAPFB_RGB565);
+    CHECK(header.stride == 32);
+
+    // Paint each row with its number
+    uint16_t row[16];
+    for (uint16_t y = 0; y < 8; y++)
+    {
+        for (int x = 0; x < 16; x++)
+            row[x] = y;
+        fb.plot_block(0, y, 15, y, row, 16);
+    }
+
+    // Scroll by three rows, and draw the new bottom rows
+    fb.scroll_vertical(3);
+    for (uint16_t y = 5; y < 8; y++)
+    {
+        for (int x = 0; x < 16; x++)
+            row[x] = 100 + y;
+        fb.plot_block(0, y, 15, y, row, 16);
+    }
+
+    // A block straddling the end of the ring
+    uint16_t block[2 * 4] = {1, 2, 3, 4, 5, 6, 7, 8};
+    fb.plot_block(4, 4, 7, 5, block, 8);
+
+    // Read it back from the file, as a viewer would see it
+    void* map = malloc(sizeof(mmapfb_header) + (32 * 8));
+    file = fopen(path, "rb");
+    CHECK(fread(map, sizeof(mmapfb_header) + (32 * 8), 1, file) == 1);
+    fclose(file);
+
+    mmapfb_header* mapped = (mmapfb_header*)map;
+    CHECK(mapped->scroll == 3);
+    for (uint16_t y = 0; y < 5; y++)
+        CHECK(viewer_row(mapped, y)[0] == y + 3);
+    for (uint16_t y = 5; y < 8; y++)
+        CHECK(viewer_row(mapped, y)[15] == 100 + y);
+    CHECK(memcmp(&viewer_row(mapped, 4)[4], &block[0], 8) == 0);
+    CHECK(memcmp(&viewer_row(mapped, 5)[4], &block[4], 8) == 0);
+
+    free(map);
+    unlink(path);
+    return check_result();
+}
@@ -0,0 +1,94 @@
+// Copyright 2021 Dominic Houghton. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Tests the RGB565 colour helpers
+
+#include "check.hpp"
+#include "rgb565.hpp"
+
+int main()
+{
+    // Packing puts each channel in its field
+    CHECK(rgb565(0xFF, 0, 0) == 0xF800);
+    CHECK(rgb565(0, 0xFF, 0) == 0x07E0);
+    CHECK(rgb565(0, 0, 0xFF) == 0x001F);
+    CHECK(rgb565(0xFF, 0xFF, 0xFF) == 0xFFFF);
+    CHECK(rgb565(0x07, 0x03, 0x07) == 0x0000);
+
+    // Unpacking spreads the field back over 0-255, so full scale survives
+    CHECK(rgb565_red(0xF800) == 0xFF);
+    CHECK(rgb565_green(0x07E0) == 0xFF);
+    CHECK(rgb565_blue(0x001F) == 0xFF);
+    CHECK(rgb565_red(0x07FF) == 0);
+    CHECK(rgb565_green(0xF81F) == 0);
+    CHECK(rgb565_blue(0xFFE0) == 0);
+
+    // Every colour survives unpacking and packing again
+    for (uint32_t c = 0; c <= 0xFFFF; c++)
+    {
+        uint16_t color = (uint16_t)c;
+        CHECK(rgb565(rgb565_red(color), rgb565_green(color), rgb565_blue(color)) == color);
+    }
+
+    // Packed values keep the top bits of each channel
+    for (uint32_t v = 0; v < 256; v++)
+    {
+        CHECK((rgb565_red(rgb565(v, 0, 0)) & 0xF8) == (v & 0xF8));
+        CHECK((rgb565_green(rgb565(0, v, 0)) & 0xFC) == (v & 0xFC));
+        CHECK((rgb565_blue(rgb565(0, 0, v)) & 0xF8) == (v & 0xF8));
+    }
+
+    // Swapping twice gives the colour back
+    CHECK(rgb565_swap(0x1234) == 0x3412);
+    for (uint32_t c = 0; c <= 0xFFFF; c++)
+        CHECK(rgb565_swap(rgb565_swap((uint16_t)c)) == c);
+
+    // Blend endpoints are exact, with no channel bleeding into the next
+    const uint16_t colors[] = { 0x0000, 0xFFFF, 0xF800, 0x07E0, 0x001F, 0x1234, 0xABCD };
+    for (uint16_t a : colors)
+    {
+        for (uint16_t b : colors)
+        {
+            CHECK(rgb565_blend(a, b, 0) == a);
+            CHECK(rgb565_blend(a, b, 256) == b);
+            CHECK(rgb565_blend(a, a, 128) == a);
+        }
+    }
+
+    // Halfway between black and white is mid grey in each channel
+    uint16_t grey = rgb565_blend(0x0000, 0xFFFF, 128);
+    CHECK(grey == ((15 << 11) | (31 << 5) | 15));
+
+    // Blending is monotonic in alpha
+    uint16_t last = 0;
+    for (uint16_t alpha = 0; alpha <= 256; alpha += 8)
+    {
+        uint16_t c = rgb565_blend(0x0000, 0xF800, alpha);
+        CHECK(c >= last);
+        CHECK((c & 0x07FF) == 0);
+        last = c;
+    }
+
+    // RGB666 packing fills each channel's low bits, so full scale stays full scale
+    const uint16_t pack[] = { 0xFFFF, 0xF800, 0x07E0, 0x001F, 0x0000, 0x8410 };
+    uint8_t wire[sizeof(pack) / 2 * 3];
+    CHECK(rgb565_pack_rgb666(pack, 6, wire, false) == 18);
+    const uint8_t expected[] = {
+        0xFC, 0xFC, 0xFC,   0xFC, 0x00, 0x00,   0x00, 0xFC, 0x00,
+        0x00, 0x00, 0xFC,   0x00, 0x00, 0x00,   0x84, 0x80, 0x84,
+    };
+    for (int i = 0; i < 18; i++)
+        CHECK(wire[i] == expected[i]);
+
+    // Byte-swapped pixels pack the same once unswapped
+    uint16_t swapped[6];
+    uint8_t swapped_wire[18];
+    for (int i = 0; i < 6; i++)
+        swapped[i] = rgb565_swap(pack[i]);
+    rgb565_pack_rgb666(swapped, 6, swapped_wire, true);
+    for (int i = 0; i < 18; i++)
+        CHECK(swapped_wire[i] == wire[i]);
+
+    return check_result();
+}
@@ -0,0 +1,167 @@
+// Copyright 2021 Dominic Houghton. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Tests the SSD1306 driver against a recording bus: the windows it opens,
+// and that the bytes it sends match a simple model of the panel
+
+#include <string.h>
+#include <vector>
+
+#include "check.hpp"
+#include "ssd1306.hpp"
+
+struct Transfer {
+    bool command;
+    std::vector<uint8_t> bytes;
+};
+
+class RecordingBus : public SSD1306_Bus {
+    public:
+        void write_commands(const uint8_t* commands, uint32_t len)
+        {
+            transfers.push_back({ true, std::vector<uint8_t>(commands, commands + len) });
+        }
+
+        void write_data(const uint8_t* data, uint32_t len)
+        {
+            transfers.push_back({ false, std::vector<uint8_t>(data, data + len) });
+        }
+
+        std::vector<Transfer> transfers;
+};
+
+// One byte per pixel, as the panel should show it
+struct Model {
+    uint8_t pixels[64][128];
+
+    void glyph(uint16_t x, uint16_t y, const uint8_t* rows)
+    {
+        for (int cy = 0; cy < 8; cy++)
+            for (int cx = 0; cx < 8; cx++)
+                pixels[y + cy][x + cx] = (rows[cy] >> (7 - cx)) & 1;
+    }
+
+    void scroll(uint16_t lines, uint16_t height)
+    {
+        memmove(pixels, pixels[lines], (height - lines) * sizeof(pixels[0]));
+        memset(pixels[height - lines], 0, lines * sizeof(pixels[0]));
+    }
+
+    uint8_t column(uint16_t page, uint16_t x)
+    {
+        uint8_t column = 0;
+        for (int bit = 0; bit < 8; bit++)
+            column |= pixels[(page * 8) + bit][x] << bit;
+        return column;
+    }
+};
+
+// Checks that transfers[index] opens the window page, x0 to x1, and the next
+// sends the model's bytes for it
+static void check_window(RecordingBus& bus, size_t index, Model& model, uint16_t page, uint16_t x0, uint16_t x1)
+{
+    CHECK(bus.transfers.size() >= (index + 2));
+    if (bus.transfers.size() < (index + 2))
+        return;
+
+    const uint8_t window[] = { 0x21, (uint8_t)x0, (uint8_t)x1, 0x22, (uint8_t)page, (uint8_t)page };
+    Transfer& command = bus.transfers[index];
+    CHECK(command.command);
+    CHECK(command.bytes == std::vector<uint8_t>(window, window + sizeof(window)));
+
+    Transfer& data = bus.transfers[index + 1];
+    CHECK(!data.command);
+    CHECK(data.bytes.size() == (size_t)(x1 - x0 + 1));
+    for (uint16_t x = x0; (x <= x1) && ((size_t)(x - x0) < data.bytes.size()); x++)
+        CHECK(data.bytes[x - x0] == model.column(page, x));
+}
+
+static void test_panel(uint16_t height)
+{
+    RecordingBus bus;
+    SSD1306 display(&bus, 128, height);
+    static Model model;
+    memset(&model, 0, sizeof(model));
+
+    // Reset clears the whole of display RAM, a page at a time
+    size_t pages = height / 8;
+    CHECK(bus.transfers.size() == (2 + (2 * pages) + 1));
+    for (uint16_t page = 0; page < pages; page++)
+        check_window(bus, 2 + (2 * page), model, page, 0, 127);
+
+    // An "L", so each column and row of the glyph is distinguishable
+    const uint8_t glyph[8] = { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x82, 0xFE };
+
+    // A page-aligned glyph is one window of eight columns
+    bus.transfers.clear();
+    CHECK(display.plot_glyph(8, 8, glyph, 1, 1, 0));
+    model.glyph(8, 8, glyph);
+    CHECK(bus.transfers.size() == 2);
+    check_window(bus, 0, model, 1, 8, 15);
+
+    // An unaligned glyph straddles two pages, each with its own window
+    bus.transfers.clear();
+    CHECK(display.plot_glyph(20, 4, glyph, 1, 1, 0));
+    model.glyph(20, 4, glyph);
+    CHECK(bus.transfers.size() == 4);
+    check_window(bus, 0, model, 0, 20, 27);
+    check_window(bus, 2, model, 1, 20, 27);
+
+    // Inverted colours
+    bus.transfers.clear();
+    uint8_t inverted[8];
+    for (int i = 0; i < 8; i++)
+        inverted[i] = ~glyph[i];
+    CHECK(display.plot_glyph(120, 8, glyph, 1, 0, 1));
+    model.glyph(120, 8, inverted);
+    check_window(bus, 0, model, 1, 120, 127);
+
+    // Glyphs that don't fit, or are scaled, are left to plot_block
+    CHECK(!display.plot_glyph(121, 0, glyph, 1, 1, 0));
+    CHECK(!display.plot_glyph(0, height - 7, glyph, 1, 1, 0));
+    CHECK(!display.plot_glyph(0, 0, glyph, 2, 1, 0));
+
+    // Dirty ranges merge across calls until the next flush
+    bus.transfers.clear();
+    display.set_autoflush(false);
+    CHECK(display.plot_glyph(40, 16, glyph, 1, 1, 0));
+    CHECK(display.plot_glyph(64, 16, glyph, 1, 1, 0));
+    model.glyph(40, 16, glyph);
+    model.glyph(64, 16, glyph);
+    CHECK(bus.transfers.empty());
+    display.flush();
+    CHECK(bus.transfers.size() == 2);
+    check_window(bus, 0, model, 2, 40, 71);
+    display.set_autoflush(true);
+
+    // A page-aligned scroll resends every page, with the rows moved up
+    bus.transfers.clear();
+    display.scroll_vertical(8);
+    model.scroll(8, height);
+    CHECK(bus.transfers.size() == (2 * pages));
+    for (uint16_t page = 0; page < pages; page++)
+        check_window(bus, 2 * page, model, page, 0, 127);
+
+    // So does an unaligned one, with each column shifted across pages
+    bus.transfers.clear();
+    display.scroll_vertical(3);
+    model.scroll(3, height);
+    CHECK(bus.transfers.size() == (2 * pages));
+    for (uint16_t page = 0; page < pages; page++)
+        check_window(bus, 2 * page, model, page, 0, 127);
+
+    // A glyph drawn after scrolling lands where the model says
+    bus.transfers.clear();
+    CHECK(display.plot_glyph(0, 13, glyph, 1, 1, 0));
+    model.glyph(0, 13, glyph);
+    check_window(bus, 0, model, 1, 0, 7);
+    check_window(bus, 2, model, 2, 0, 7);
+}
+
+int main()
+{
+    test_panel(64);
+    test_panel(32);
+    return check_result();
+}
@@ -0,0 +1,191 @@
+#!/usr/bin/env python3
+# Copyright 2021 Dominic Houghton. All rights reserved.
+# Use of this source code is governed by a BSD-style
+# license that can be found in the LICENSE file.
+
+# Shows the screen mirror stream from FBMirror (fbmirror.hpp) in a terminal.
+#
+# Usage: fbmirror_view.py /dev/ttyACM0     Follow a device's USB stdio live
+#        fbmirror_view.py --dump capture   Print the final screen of a capture
+#
+# Bytes outside frames, such as ordinary stdio text, are skipped. The screen
+# appears once a whole-screen resend has been seen, which happens every few
+# seconds. The bytes received per update are shown under the screen.
+
+import os
+import sys
+import termios
+import tty
+
+SYNC = b"\xfb\x4d"
+MAX_PAYLOAD = 0xFFFF
+
+MONO, RGB565, RGB565_SWAPPED, XRGB8888 = range(4)
+
+
+class Screen:
+    def __init__(self):
+        self.width = 0
+        self.height = 0
+        self.format = RGB565
+        self.palette = [0] * 16
+        self.cells = []
+        self.x = self.y = self.attr = 0
+        self.updates = 0
+
+    def blank_row(self, attr):
+        return [(0, attr)] * self.width
+
+    def write(self, glyph):
+        if self.y < self.height and self.x < self.width:
+            self.cells[self.y][self.x] = (glyph, self.attr)
+        self.updates += 1
+        self.x += 1
+        if self.x >= self.width:
+            self.x = 0
+            self.y += 1
+
+    def apply(self, payload):
+        i = 0
+        while i < len(payload):
+            op = payload[i]
+            if op & 0x80:
+                n = op & 0x7F
+                for glyph in payload[i + 1:i + 1 + n]:
+                    self.write(glyph)
+                i += 1 + n
+            elif op == 0x01:
+                self.width, self.height, self.format = payload[i + 1:i + 4]
+                self.cells = [self.blank_row(0) for _ in range(self.height)]
+                self.x = self.y = self.attr = 0
+                i += 4
+            elif op == 0x02:
+                index = payload[i + 1]
+                self.palette[index] = int.from_bytes(payload[i + 2:i + 6], "little")
+                i += 6
+            elif op == 0x03:
+                self.cells = [self.blank_row(payload[i + 1]) for _ in range(self.height)]
+                self.x = self.y = 0
+                self.updates += 1
+                i += 2
+            elif op == 0x04:
+                self.cells = self.cells[1:] + [self.blank_row(payload[i + 1])]
+                self.y = max(self.y - 1, 0)
+                self.updates += 1
+                i += 2
+            elif op == 0x05:
+                self.x, self.y = payload[i + 1:i + 3]
+                i += 3
+            elif op == 0x06:
+                self.attr = payload[i + 1]
+                i += 2
+            elif op == 0x07:
+                self.x = 0
+                self.y += 1
+                i += 1
+            elif op == 0x08:
+                for _ in range(payload[i + 1]):
+                    self.write(payload[i + 2])
+                i += 3
+            else:
+                raise ValueError("unknown operation 0x%02x" % op)
+
+    def rgb(self, index):
+        c = self.palette[index]
+        if self.format == MONO:
+            return (255, 255, 255) if c else (0, 0, 0)
+        if self.format == XRGB8888:
+            return ((c >> 16) & 0xFF, (c >> 8) & 0xFF, c & 0xFF)
+        if self.format == RGB565_SWAPPED:
+            c = ((c & 0xFF) << 8) | ((c >> 8) & 0xFF)
+        r, g, b = (c >> 11) & 0x1F, (c >> 5) & 0x3F, c & 0x1F
+        return ((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2))
+
+    def text(self, color):
+        lines = []
+        for row in self.cells:
+            line = ""
+            for glyph, attr in row:
+                ch = chr(glyph + 0x20) if glyph < 95 else "?"
+                if color:
+                    fg, bg = self.rgb(attr >> 4), self.rgb(attr & 0x0F)
+                    line += "\x1b[38;2;%d;%d;%dm\x1b[48;2;%d;%d;%dm" % (fg + bg)
+                line += ch
+            lines.append(line + ("\x1b[0m" if color else ""))
+        return "\n".join(lines)
+
+
+def frames(data):
+    """Splits complete frames from the front of data, returning them and what's left."""
+    found = []
+    while True:
+        start = data.find(SYNC)
+        if start < 0:
+            return found, data[-1:]
+        data = data[start:]
+        if len(data) < 4:
+            return found, data
+        length = data[2] | (data[3] << 8)
+        if len(data) < 5 + length:
+            return found, data
+        payload = data[4:4 + length]
+        if (sum(payload) & 0xFF) == data[4 + length]:
+            found.append(payload)
+            data = data[5 + length:]
+        else:
+            # Not a frame after all, e.g. the marker bytes appeared in text
+            data = data[1:]
+
+
+def main():
+    dump = "--dump" in sys.argv[1:]
+    paths = [a for a in sys.argv[1:] if a != "--dump"]
+    if len(paths) != 1:
+        sys.exit("usage: fbmirror_view.py [--dump] DEVICE_OR_CAPTURE")
+
+    fd = os.open(paths[0], os.O_RDONLY)
+
+    # A serial device opens in cooked mode, which would act on the stream's
+    # bytes: 0x03 raising SIGINT, CR becoming LF, XON/XOFF pausing it, and
+    # line editing. Take it raw, and put it back as it was afterwards.
+    saved = None
+    if os.isatty(fd):
+        saved = termios.tcgetattr(fd)
+        tty.setraw(fd)
+
+    screen = Screen()
+    synced = False
+    received = 0
+    pending = b""
+    try:
+        while True:
+            chunk = os.read(fd, 4096)
+            if not chunk:
+                break
+            found, pending = frames(pending + chunk)
+            for payload in found:
+                # Ignore changes until the first whole screen arrives
+                if payload[0] == 0x01:
+                    synced = True
+                if not synced:
+                    continue
+                received += len(payload) + 5
+                screen.apply(payload)
+            if found and synced and not dump:
+                sys.stdout.write("\x1b[H\x1b[2J" + screen.text(True) + "\n")
+                sys.stdout.write("%d bytes, %d updates, %.2f bytes/update\n" %
+                                 (received, screen.updates, received / max(screen.updates, 1)))
+                sys.stdout.flush()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        if saved is not None:
+            termios.tcsetattr(fd, termios.TCSADRAIN, saved)
+        os.close(fd)
+
+    if dump:
+        print(screen.text(False))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,77 @@
+// Copyright 2021 Dominic Houghton. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Soak test for FBConsole on a Linux host, using the memory-mapped framebuffer
+//
+// Copies stdin to a console drawn into a framebuffer file (or a device such
+// as /dev/fb0), then reports the throughput and pixel counts. For example:
+//
+//   cmake -S tests -B build-host && cmake --build build-host
+//   ./build-host/fbsoak console.fb 320 240 < /var/log/syslog
+//   ./build-host/fbsoak /dev/fb0 < /var/log/syslog
+//
+// tools/mmapfb2ppm.py takes a snapshot of a framebuffer file, while this is
+// running or afterwards.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "FBConsole.hpp"
+#include "mmapfb.hpp"
+#include "gamefont.hpp"
+
+typedef MmapFramebuffer<uint16_t> soak_fb_t;
+typedef FBConsole<uint16_t, soak_fb_t> soak_console_t;
+
+int main(int argc, char** argv)
+{
+    if ((argc != 2) && (argc != 4))
+    {
+        fprintf(stderr, "Usage: %s FILE WIDTH HEIGHT < input\n       %s DEVICE < input\n", argv[0], argv[0]);
+        return 2;
+    }
+
+    soak_fb_t* display;
+    if (argc == 4)
+        display = new soak_fb_t(argv[1], atoi(argv[2]), atoi(argv[3]));
+    else
+        display = new soak_fb_t(argv[1]);
+    if (!display->is_open())
+    {
+        fprintf(stderr, "%s: can't open %s\n", argv[0], argv[1]);
+        return 1;
+    }
+
+    soak_console_t* console = new soak_console_t(display, (uint8_t*)&font);
+    console->set_foreground(display->get_color(0xFF, 0xFF, 0xFF));
+    console->set_background(display->get_color(0x00, 0x00, 0x00));
+    console->clear();
+
+    timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    char buffer[4096];
+    size_t len;
+    uint64_t chars = 0;
+    while ((len = fread(buffer, 1, sizeof(buffer), stdin)) > 0)
+    {
+        for (size_t i = 0; i < len; i++)
+            console->put_char(buffer[i]);
+        chars += len;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + ((end.tv_nsec - start.tv_nsec) / 1e9);
+
+    uint32_t sent, saved;
+    console->get_stats(&sent, &saved);
+    printf("%llu chars in %.3f s (%.0f chars/s)\n", (unsigned long long)chars, seconds,
+           (seconds > 0) ? (chars / seconds) : 0.0);
+    printf("%lu pixels sent, %lu saved\n", (unsigned long)sent, (unsigned long)saved);
+
+    delete console;
+    delete display;
+    return 0;
+}
@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+# Copyright 2021 Dominic Houghton. All rights reserved.
+# Use of this source code is governed by a BSD-style
+# license that can be found in the LICENSE file.
+
+# Converts a dump from fbtrace_dump (captured from USB stdio) into Chrome
+# trace JSON, for chrome://tracing or https://ui.perfetto.dev
+#
+# Usage: fbtrace2chrome.py capture.txt > trace.json
+# Lines that aren't part of a dump are ignored, so a whole serial log can be
+# passed in. Multiple dumps are concatenated.
+
+import json
+import sys
+
+WINDOW, BURST_BEGIN, BURST_END, SCROLL, GLYPH_BEGIN, GLYPH_END = range(1, 7)
+
+# Console events are shown on one track, each display on its own
+CONSOLE_TID = 1000
+
+
+def display_tid(source):
+    return source
+
+
+def convert(lines):
+    events = []
+    last = None
+    wraps = 0
+
+    for line in lines:
+        fields = line.split()
+        if len(fields) < 2 or fields[0] != "FBTRACE":
+            continue
+        if fields[1] in ("BEGIN", "END"):
+            if fields[1] == "BEGIN" and len(fields) > 3 and int(fields[3]) > 0:
+                print("warning: %s events were dropped" % fields[3], file=sys.stderr)
+            continue
+
+        timestamp, type_, source, a, b, c, d = (int(f, 16) for f in fields[1:8])
+
+        # The timestamps are 32-bit microseconds, which wrap after ~71 minutes
+        if last is not None and timestamp < last:
+            wraps += 1
+        last = timestamp
+        ts = timestamp + (wraps << 32)
+
+        if type_ == WINDOW:
+            events.append({"name": "window", "ph": "i", "s": "t", "ts": ts,
+                           "pid": 0, "tid": display_tid(source),
+                           "args": {"x0": a, "y0": b, "x1": c, "y1": d}})
+        elif type_ == BURST_BEGIN:
+            events.append({"name": "pixels", "ph": "B", "ts": ts,
+                           "pid": 0, "tid": display_tid(source),
+                           "args": {"bytes": d}})
+        elif type_ == BURST_END:
+            events.append({"name": "pixels", "ph": "E", "ts": ts,
+                           "pid": 0, "tid": display_tid(source)})
+        elif type_ == SCROLL:
+            events.append({"name": "scroll", "ph": "i", "s": "t", "ts": ts,
+                           "pid": 0, "tid": display_tid(source),
+                           "args": {"pixels": a, "offset": d}})
+        elif type_ == GLYPH_BEGIN:
+            events.append({"name": "glyph %r" % chr(a), "ph": "B", "ts": ts,
+                           "pid": 0, "tid": CONSOLE_TID,
+                           "args": {"x": b, "y": c, "drawn": bool(d)}})
+        elif type_ == GLYPH_END:
+            events.append({"name": "glyph %r" % chr(a), "ph": "E", "ts": ts,
+                           "pid": 0, "tid": CONSOLE_TID})
+
+    metadata = [{"name": "thread_name", "ph": "M", "pid": 0, "tid": CONSOLE_TID,
+                 "args": {"name": "FBConsole"}}]
+    for source in sorted({e["tid"] for e in events if e["tid"] != CONSOLE_TID}):
+        metadata.append({"name": "thread_name", "ph": "M", "pid": 0, "tid": source,
+                         "args": {"name": "display spi%d" % source}})
+
+    return {"traceEvents": metadata + events, "displayTimeUnit": "ms"}
+
+
+def main():
+    if len(sys.argv) > 1:
+        with open(sys.argv[1], errors="replace") as f:
+            trace = convert(f)
+    else:
+        trace = convert(sys.stdin)
+    json.dump(trace, sys.stdout)
+
+
+if __name__ == "__main__":
+    main()
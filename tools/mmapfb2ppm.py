@@ -0,0 +1,45 @@
+#!/usr/bin/env python3
+# Copyright 2021 Dominic Houghton. All rights reserved.
+# Use of this source code is governed by a BSD-style
+# license that can be found in the LICENSE file.
+
+# Snapshots a framebuffer file written by MmapFramebuffer (mmapfb.hpp) into a
+# PPM image, unrolling the scroll ring so logical row 0 is at the top.
+#
+# Usage: mmapfb2ppm.py console.fb > screen.ppm
+# The file can be read while the console is still writing to it.
+
+import struct
+import sys
+
+MAGIC = 0x4D434246
+HEADER = struct.Struct("<IIIHHIIII")
+RGB565, XRGB8888 = 0, 1
+
+
+def main():
+    with open(sys.argv[1], "rb") as f:
+        data = f.read()
+
+    (magic, version, header_size, width, height, fmt, stride, scroll,
+     frame) = HEADER.unpack_from(data)
+    if magic != MAGIC:
+        sys.exit("%s: not a framebuffer file" % sys.argv[1])
+
+    out = bytearray()
+    for y in range(height):
+        offset = header_size + ((y + scroll) % height) * stride
+        if fmt == RGB565:
+            for (p,) in struct.iter_unpack("<H", data[offset:offset + width * 2]):
+                r, g, b = (p >> 11) & 0x1F, (p >> 5) & 0x3F, p & 0x1F
+                out += bytes(((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2)))
+        else:
+            for (p,) in struct.iter_unpack("<I", data[offset:offset + width * 4]):
+                out += bytes(((p >> 16) & 0xFF, (p >> 8) & 0xFF, p & 0xFF))
+
+    sys.stdout.buffer.write(b"P6\n%d %d\n255\n" % (width, height))
+    sys.stdout.buffer.write(out)
+
+
+if __name__ == "__main__":
+    main()